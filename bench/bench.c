@@ -0,0 +1,267 @@
+// benchmark harness timing the phases of compiling documents separately:
+// parsing, the HTMLification of text done while parsing, and emitting HTML.
+// it is built from the library source with -DCMFC_BENCH, so as to reach its
+// internals and to count the allocations made in each phase.
+//
+// usage: bench [-n runs] file...
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+struct alloc_stats
+{
+	size_t count;
+	size_t bytes;
+};
+
+struct phase_stats
+{
+	double secs;
+	struct alloc_stats allocs;
+};
+
+static void *bench_calloc(size_t n, size_t size);
+static void *bench_malloc(size_t size);
+static void *bench_realloc(void *ptr, size_t size);
+static void *bench_reallocarray(void *ptr, size_t n, size_t size);
+
+static struct alloc_stats allocs;
+
+// every allocation made by the library is counted.
+#define calloc(n, size) bench_calloc(n, size)
+#define malloc(size) bench_malloc(size)
+#define realloc(ptr, size) bench_realloc(ptr, size)
+#define reallocarray(ptr, n, size) bench_reallocarray(ptr, n, size)
+
+#include "../libcmfc.c"
+
+#undef calloc
+#undef malloc
+#undef realloc
+#undef reallocarray
+
+static int bench_file(char const *file, int runs);
+static char *file_load(char const *file, size_t *len);
+static void phase_begin(struct phase_stats *ps);
+static void phase_end(struct phase_stats *ps);
+static void phase_keep_best(struct phase_stats *best, struct phase_stats const *ps, bool first);
+static void phase_print(char const *name, struct phase_stats const *ps, size_t len);
+
+int
+main(int argc, char const *argv[])
+{
+	int runs = 5;
+	
+	int first = 1;
+	if (argc > 2 && !strcmp(argv[1], "-n"))
+	{
+		runs = atoi(argv[2]);
+		first = 3;
+	}
+	
+	if (first >= argc || runs < 1)
+	{
+		fprintf(stderr, "usage: %s [-n runs] file...\n", argv[0]);
+		return 1;
+	}
+	
+	printf("%-24s %8s  %-8s %10s %10s %10s\n", "file", "MB", "phase", "MB/s", "allocs", "alloc MB");
+	
+	int rc = 0;
+	for (int i = first; i < argc; ++i)
+		rc |= bench_file(argv[i], runs);
+	
+	return rc;
+}
+
+// compile a document `runs` times, keeping the fastest time of each phase.
+// HTMLification is timed as the difference between a normal parse and one
+// with HTMLification skipped.
+static int
+bench_file(char const *file, int runs)
+{
+	size_t len;
+	char *data = file_load(file, &len);
+	if (!data)
+		return 1;
+	
+	struct phase_stats parse_best = {0}, parse_raw_best = {0}, emit_best = {0};
+	for (int run = 0; run < runs; ++run)
+	{
+		struct phase_stats parse_stats, parse_raw_stats, emit_stats;
+		struct cmfc_opts opts =
+		{
+			.file = file,
+		};
+		
+		struct doc_ctx ctx;
+		doc_ctx_init(&ctx, &opts);
+		bench_no_htmlify = true;
+		phase_begin(&parse_raw_stats);
+		int parse_rc = parse(&ctx, &ctx.doc_root, data, len, file);
+		phase_end(&parse_raw_stats);
+		bench_no_htmlify = false;
+		doc_ctx_release(&ctx);
+		
+		doc_ctx_init(&ctx, &opts);
+		phase_begin(&parse_stats);
+		parse_rc |= parse(&ctx, &ctx.doc_root, data, len, file);
+		phase_end(&parse_stats);
+		
+		if (parse_rc || doc_data_verify(&ctx))
+		{
+			char msg[2048];
+			cmfc_error_format(msg, sizeof(msg), &ctx.err);
+			fputs(msg, stderr);
+			doc_ctx_release(&ctx);
+			free(data);
+			return 1;
+		}
+		
+		ctx.out.cap = len + len / 4 + 4096;
+		ctx.out.data = malloc(ctx.out.cap);
+		phase_begin(&emit_stats);
+		gen_html(&ctx);
+		phase_end(&emit_stats);
+		doc_ctx_release(&ctx);
+		
+		phase_keep_best(&parse_best, &parse_stats, !run);
+		phase_keep_best(&parse_raw_best, &parse_raw_stats, !run);
+		phase_keep_best(&emit_best, &emit_stats, !run);
+	}
+	
+	struct phase_stats htmlify_best =
+	{
+		.secs = parse_best.secs - parse_raw_best.secs,
+		.allocs =
+		{
+			.count = parse_best.allocs.count - parse_raw_best.allocs.count,
+			.bytes = parse_best.allocs.bytes - parse_raw_best.allocs.bytes,
+		},
+	};
+	struct phase_stats total =
+	{
+		.secs = parse_best.secs + emit_best.secs,
+		.allocs =
+		{
+			.count = parse_best.allocs.count + emit_best.allocs.count,
+			.bytes = parse_best.allocs.bytes + emit_best.allocs.bytes,
+		},
+	};
+	
+	char const *name = strrchr(file, '/') ? strrchr(file, '/') + 1 : file;
+	printf("%-24s %8.1f  ", name, len / 1e6);
+	phase_print("parse", &parse_raw_best, len);
+	printf("%-24s %8s  ", "", "");
+	phase_print("htmlify", &htmlify_best, len);
+	printf("%-24s %8s  ", "", "");
+	phase_print("emit", &emit_best, len);
+	printf("%-24s %8s  ", "", "");
+	phase_print("total", &total, len);
+	
+	free(data);
+	return 0;
+}
+
+static void *
+bench_calloc(size_t n, size_t size)
+{
+	++allocs.count;
+	allocs.bytes += n * size;
+	return calloc(n, size);
+}
+
+static void *
+bench_malloc(size_t size)
+{
+	++allocs.count;
+	allocs.bytes += size;
+	return malloc(size);
+}
+
+static void *
+bench_realloc(void *ptr, size_t size)
+{
+	++allocs.count;
+	allocs.bytes += size;
+	return realloc(ptr, size);
+}
+
+static void *
+bench_reallocarray(void *ptr, size_t n, size_t size)
+{
+	++allocs.count;
+	allocs.bytes += n * size;
+	return reallocarray(ptr, n, size);
+}
+
+// read a whole file, followed by a null terminator as the parser expects.
+static char *
+file_load(char const *file, size_t *len)
+{
+	FILE *fp = fopen(file, "rb");
+	if (!fp)
+	{
+		fprintf(stderr, "err: failed to open file for reading: %s!\n", file);
+		return NULL;
+	}
+	
+	fseek(fp, 0, SEEK_END);
+	*len = ftell(fp);
+	fseek(fp, 0, SEEK_SET);
+	
+	char *data = malloc(*len + 1);
+	if (fread(data, 1, *len, fp) != *len)
+	{
+		fprintf(stderr, "err: failed to read file: %s!\n", file);
+		fclose(fp);
+		free(data);
+		return NULL;
+	}
+	data[*len] = 0;
+	
+	fclose(fp);
+	return data;
+}
+
+static void
+phase_begin(struct phase_stats *ps)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	
+	ps->secs = ts.tv_sec + ts.tv_nsec / 1e9;
+	ps->allocs = allocs;
+}
+
+static void
+phase_end(struct phase_stats *ps)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	
+	ps->secs = ts.tv_sec + ts.tv_nsec / 1e9 - ps->secs;
+	ps->allocs.count = allocs.count - ps->allocs.count;
+	ps->allocs.bytes = allocs.bytes - ps->allocs.bytes;
+}
+
+static void
+phase_keep_best(struct phase_stats *best, struct phase_stats const *ps, bool first)
+{
+	if (first || ps->secs < best->secs)
+		*best = *ps;
+}
+
+// throughput is always given relative to the size of the markup, so that the
+// phases can be compared against each other.
+static void
+phase_print(char const *name, struct phase_stats const *ps, size_t len)
+{
+	double secs = ps->secs > 1e-9 ? ps->secs : 1e-9;
+	printf("%-8s %10.1f %10zu %10.1f\n", name, len / 1e6 / secs, ps->allocs.count, ps->allocs.bytes / 1e6);
+}
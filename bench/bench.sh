@@ -0,0 +1,21 @@
+#!/bin/sh
+
+# generates a synthetic document for each construct and reports the
+# throughput and allocations of each phase of compiling them. the size of the
+# documents is taken from BENCH_SIZE, in bytes.
+#
+# usage: bench/bench.sh [gen binary] [bench binary]
+
+GEN=${1:-bench/gen}
+BENCH=${2:-bench/bench}
+SIZE=${BENCH_SIZE:-16000000}
+RUNS=${BENCH_RUNS:-5}
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+
+for kind in lists tables footnotes code inline mixed
+do
+	"$GEN" $kind "$SIZE" > "$TMP/$kind.cmf" || exit 1
+done
+
+"$BENCH" -n "$RUNS" "$TMP/lists.cmf" "$TMP/tables.cmf" "$TMP/footnotes.cmf" "$TMP/code.cmf" "$TMP/inline.cmf" "$TMP/mixed.cmf"
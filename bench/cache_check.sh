@@ -0,0 +1,82 @@
+#!/bin/sh
+
+# checks that documents rebuilt incrementally from the build cache match fresh
+# builds, including when the options change between the builds. each case
+# builds the example document with the first options, edits it, rebuilds it
+# with the second options and compares the output with that of a fresh build.
+#
+# usage: bench/cache_check.sh [cmfc binary]
+
+CMFC=${1:-./cmfc}
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+
+check()
+{
+	rm -rf "$TMP/cache" "$TMP/doc.html"
+	cp examples/hello.cmf "$TMP/doc.cmf"
+	
+	# options are split into words on purpose.
+	"$CMFC" $1 -C "$TMP/cache" -o "$TMP/doc.html" "$TMP/doc.cmf" || return 1
+	printf '\n=An edited title\n\n    An edited paragraph.\n' >> "$TMP/doc.cmf"
+	"$CMFC" $2 -C "$TMP/cache" -o "$TMP/doc.html" "$TMP/doc.cmf" || return 1
+	"$CMFC" $2 -o "$TMP/fresh.html" "$TMP/doc.cmf" || return 1
+	cmp -s "$TMP/doc.html" "$TMP/fresh.html"
+}
+
+# first and second options of each case, separated by a colon.
+rc=0
+while IFS=: read -r first second
+do
+	if ! check "$first" "$second"
+	then
+		echo "'$first' then '$second': cached rebuild differs from a fresh build"
+		rc=1
+	fi
+done <<CASES
+:
+:-s styles/shell.css
+-s styles/shell.css:-s styles/academic.css
+-H:
+:-H
+-t:
+:-t
+-H:-t
+:-x
+-x:
+CASES
+
+# compressed copies written with -z are rebuilt if they are removed or altered,
+# though the output itself is untouched.
+rm -rf "$TMP/cache"
+cp examples/hello.cmf "$TMP/doc.cmf"
+"$CMFC" -z -o "$TMP/fresh.html" "$TMP/doc.cmf" || rc=1
+"$CMFC" -z -C "$TMP/cache" -o "$TMP/doc.html" "$TMP/doc.cmf" || rc=1
+for alter in 'rm "$TMP/doc.html.gz"' 'echo x > "$TMP/doc.html.gz"'
+do
+	eval "$alter"
+	"$CMFC" -z -C "$TMP/cache" -o "$TMP/doc.html" "$TMP/doc.cmf" || rc=1
+	if ! cmp -s "$TMP/doc.html.gz" "$TMP/fresh.html.gz"
+	then
+		echo "'$alter': cached rebuild left a stale compressed copy"
+		rc=1
+	fi
+done
+
+# titles are never given the id of a footnote, whether built fresh or cached.
+rm -rf "$TMP/cache"
+printf 'DOC-TITLE ids\n\n=named\n\n=1\n\n[^named] def\n\n[^1] one\n' > "$TMP/doc.cmf"
+"$CMFC" -H -C "$TMP/cache" -o "$TMP/doc.html" "$TMP/doc.cmf" || rc=1
+printf '\n=named\n' >> "$TMP/doc.cmf"
+for opts in "-H" "-H -C $TMP/cache" "-H -n"
+do
+	"$CMFC" $opts -o "$TMP/doc.html" "$TMP/doc.cmf" || rc=1
+	if [ -n "$(grep -o 'id="[^"]*"' "$TMP/doc.html" | sort | uniq -d)" ]
+	then
+		echo "'$opts': a title was given the id of a footnote"
+		rc=1
+	fi
+done
+
+[ $rc -eq 0 ] && echo "cache-check: ok"
+exit $rc
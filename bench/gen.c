@@ -0,0 +1,310 @@
+// generator of large synthetic CMF documents for benchmarking. each kind of
+// document stresses one construct; `mixed` interleaves all of them. output is
+// deterministic for a given seed.
+//
+// usage: gen kind size [seed]
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define WRAP_COLUMN 80
+
+enum put_flag
+{
+	PF_NO_WRAP = 0x1, // keep to the current line, e.g. in list items.
+	PF_NO_BARS = 0x2, // leave out markup containing `|`, e.g. in table cells.
+};
+
+enum gen_kind
+{
+	GK_LISTS = 0,
+	GK_TABLES,
+	GK_FOOTNOTES,
+	GK_CODE,
+	GK_INLINE,
+	GK_MIXED,
+};
+
+static void emit(char const *fmt, ...);
+static void gen_code(void);
+static void gen_footnotes(void);
+static void gen_inline(void);
+static void gen_lists(void);
+static void gen_tables(void);
+static void put_inline(int nwords, int density, unsigned flags);
+static void put_token(char const *s, unsigned flags);
+static uint64_t rng(void);
+static int rng_range(int n);
+
+static char const *words[] =
+{
+	"lorem", "ipsum", "dolor", "sit", "amet", "consectetur", "adipiscing",
+	"elit", "sed", "do", "eiusmod", "tempor", "incididunt", "ut", "labore",
+	"et", "dolore", "magna", "aliqua", "enim", "ad", "minim", "veniam", "quis",
+	"nostrud", "exercitation", "ullamco", "laboris", "nisi", "aliquip", "ex",
+	"ea", "commodo", "consequat", "duis", "aute", "irure", "in",
+	"reprehenderit", "voluptate", "velit", "esse", "cillum", "fugiat", "nulla",
+	"pariatur",
+};
+
+// inline markup, roughly as often as it appears in prose written by hand.
+static char const *spans[] =
+{
+	"**bold text**", "*italic text*", "`code_span()`", "@[https://example.com/page|a link]",
+	"@[https://example.com/\"quoted\"]", "en--dash", "em---dash", "line//break", "\\*escaped\\*",
+	"a < b", "b > a", "this & that", "\"quoted\"", "it's", "\\@not a link",
+};
+
+static char const *code_lines[] =
+{
+	"static int",
+	"parse(struct ctx *ctx, char const *data, size_t len)",
+	"{",
+	"\tfor (size_t i = 0; i < len && data[i] != '\\n'; ++i)",
+	"\t\tctx->sum += data[i] * 31 & 0xff;",
+	"\tif (ctx->sum > 0 && *ctx->name)",
+	"\t\treturn fprintf(stderr, \"<%s> %d\\n\", ctx->name, ctx->sum);",
+	"\treturn -1; // a comment with -- dashes and ** stars.",
+	"}",
+	"",
+};
+
+static uint64_t rng_state;
+static size_t line_len;
+static long long out_len;
+
+int
+main(int argc, char const *argv[])
+{
+	static char const *kinds[] = {"lists", "tables", "footnotes", "code", "inline", "mixed"};
+	
+	if (argc < 3 || argc > 4)
+	{
+		fprintf(stderr, "usage: %s lists|tables|footnotes|code|inline|mixed size [seed]\n", argv[0]);
+		return 1;
+	}
+	
+	enum gen_kind kind = GK_MIXED + 1;
+	for (size_t i = 0; i < sizeof(kinds) / sizeof(kinds[0]); ++i)
+	{
+		if (!strcmp(argv[1], kinds[i]))
+			kind = i;
+	}
+	
+	if (kind > GK_MIXED)
+	{
+		fprintf(stderr, "err: unknown document kind: %s!\n", argv[1]);
+		return 1;
+	}
+	
+	long long size = atoll(argv[2]);
+	rng_state = argc == 4 ? strtoull(argv[3], NULL, 10) : 1;
+	rng_state = rng_state * 0x9e3779b97f4a7c15ull + 1;
+	
+	static char out_buf[1 << 16];
+	setvbuf(stdout, out_buf, _IOFBF, sizeof(out_buf));
+	
+	emit("DOC-TITLE Synthetic %s benchmark\n"
+	     "DOC-AUTHOR gen\n"
+	     "DOC-CREATED 2024-01-01\n\n",
+	     kinds[kind]);
+	
+	static void (*gens[])(void) = {gen_lists, gen_tables, gen_footnotes, gen_code, gen_inline};
+	for (int section = 0; out_len < size; ++section)
+	{
+		emit("=Section %d\n\n", section);
+		if (kind == GK_MIXED)
+			gens[section % (sizeof(gens) / sizeof(gens[0]))]();
+		else
+			gens[kind]();
+	}
+	
+	return fflush(stdout) != 0;
+}
+
+static void
+emit(char const *fmt, ...)
+{
+	va_list args;
+	va_start(args, fmt);
+	out_len += vprintf(fmt, args);
+	va_end(args);
+}
+
+// fenced code blocks of a few hundred lines full of characters to escape.
+static void
+gen_code(void)
+{
+	for (int block = 0; block < 4; ++block)
+	{
+		emit("```\n");
+		int nlines = 100 + rng_range(300);
+		for (int i = 0; i < nlines; ++i)
+			emit("%s\n", code_lines[i % (sizeof(code_lines) / sizeof(code_lines[0]))]);
+		emit("```\n\n");
+	}
+}
+
+// paragraphs with a footnote reference every few words, each followed by the
+// footnotes it references.
+static void
+gen_footnotes(void)
+{
+	static int next_note = 1;
+	
+	for (int para = 0; para < 8; ++para)
+	{
+		int first = next_note;
+		
+		emit("    ");
+		line_len = 4;
+		for (int sentence = 0; sentence < 12; ++sentence)
+		{
+			char ref[64];
+			put_inline(4 + rng_range(8), 0, 0);
+			snprintf(ref, sizeof(ref), "[^note%d|%d].", next_note, next_note);
+			put_token(ref, 0);
+			++next_note;
+		}
+		emit("\n\n");
+		
+		for (int note = first; note < next_note; ++note)
+		{
+			emit("[^note%d]**[%d]**:", note, note);
+			line_len = 16;
+			put_inline(6 + rng_range(20), 8, 0);
+			emit("\n\n");
+		}
+	}
+}
+
+// paragraphs and blockquotes dense with inline markup.
+static void
+gen_inline(void)
+{
+	for (int para = 0; para < 16; ++para)
+	{
+		bool quote = rng_range(4) == 0;
+		emit(quote ? "      " : "    ");
+		line_len = quote ? 6 : 4;
+		put_inline(60 + rng_range(120), 3, 0);
+		emit("\n\n");
+	}
+}
+
+// deep unordered and ordered lists, their depth wandering up and down.
+static void
+gen_lists(void)
+{
+	for (int list = 0; list < 4; ++list)
+	{
+		char bullet = list % 2 ? '#' : '*';
+		int depth = 1;
+		int nitems = 100 + rng_range(200);
+		for (int item = 0; item < nitems; ++item)
+		{
+			for (int d = 0; d < depth; ++d)
+				emit("%c", bullet);
+			
+			// items are kept to a single line, as a wrapped line beginning
+			// with the bullet would begin another item. they begin with a
+			// word, as markup beginning with the bullet would deepen them.
+			line_len = 0;
+			put_token(words[rng_range(sizeof(words) / sizeof(words[0]))], PF_NO_WRAP);
+			put_inline(2 + rng_range(12), 6, PF_NO_WRAP);
+			emit("\n");
+			
+			int step = rng_range(3) - 1;
+			if (depth + step >= 1 && depth + step <= 16)
+				depth += step;
+		}
+		emit("\n");
+	}
+}
+
+// wide tables whose rows span several continuation lines.
+static void
+gen_tables(void)
+{
+	for (int table = 0; table < 4; ++table)
+	{
+		int ncols = 4 + rng_range(12);
+		int nrows = 20 + rng_range(80);
+		
+		emit("-----\n");
+		for (int row = 0; row < nrows; ++row)
+		{
+			int nlines = 1 + rng_range(4);
+			for (int line = 0; line < nlines; ++line)
+			{
+				for (int col = 0; col < ncols; ++col)
+				{
+					emit("|");
+					line_len = 0;
+					put_inline(1 + rng_range(5), rng_range(2) ? 6 : 0, PF_NO_WRAP | PF_NO_BARS);
+				}
+				emit("|\n");
+			}
+			emit("-----\n");
+		}
+		emit("\n");
+	}
+}
+
+// write `nwords` words, with inline markup in place of one word in
+// `density`, or none if 0.
+static void
+put_inline(int nwords, int density, unsigned flags)
+{
+	size_t nspans = sizeof(spans) / sizeof(spans[0]);
+	for (int i = 0; i < nwords; ++i)
+	{
+		char const *span = density && !rng_range(density) ? spans[rng_range(nspans)] : NULL;
+		if (span && !(flags & PF_NO_BARS && strchr(span, '|')))
+			put_token(span, flags);
+		else
+			put_token(words[rng_range(sizeof(words) / sizeof(words[0]))], flags);
+	}
+}
+
+// write a space-separated token, wrapping lines which would grow too long.
+// continuation lines never begin with a space, so they never begin a new
+// block.
+static void
+put_token(char const *s, unsigned flags)
+{
+	size_t len = strlen(s);
+	if (line_len && line_len + 1 + len > WRAP_COLUMN && !(flags & PF_NO_WRAP))
+	{
+		emit("\n");
+		line_len = 0;
+	}
+	else if (line_len)
+	{
+		emit(" ");
+		++line_len;
+	}
+	
+	emit("%s", s);
+	line_len += len;
+}
+
+// xorshift64*.
+static uint64_t
+rng(void)
+{
+	rng_state ^= rng_state >> 12;
+	rng_state ^= rng_state << 25;
+	rng_state ^= rng_state >> 27;
+	return rng_state * 0x2545f4914f6cdd1dull;
+}
+
+static int
+rng_range(int n)
+{
+	return rng() % n;
+}
@@ -0,0 +1,61 @@
+#!/bin/sh
+
+# differential check of the HTMLify fast path against the original
+# byte-at-a-time implementation. the given binary must be built with
+# -DHTMLIFY_CHECK, which makes it abort on the first mismatch.
+#
+# usage: bench/htmlify_check.sh [cmfc-check binary]
+
+CMFC=${1:-./cmfc-check}
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+
+# random documents made mostly of special bytes and inline markup.
+gen_soup()
+{
+	awk -v seed="$1" 'BEGIN {
+		srand(seed);
+		n = split("\\ @ [ ] | ` * < > & \" '"'"' - / ^ @[ [^ ** -- --- // \\\\ \\| plain text", tok, " ");
+		print "DOC-TITLE soup " seed "\n";
+		for (b = 0; b < 200; ++b)
+		{
+			if (rand() < 0.05)
+			{
+				print "DOC-RAW-TEXT " int(rand() * 2) "\n";
+				continue;
+			}
+			
+			line = rand() < 0.5 ? "    " : "";
+			for (w = int(rand() * 40); w > 0; --w)
+				line = line tok[int(rand() * n) + 1] (rand() < 0.3 ? " " : "");
+			print line "\n";
+		}
+	}'
+}
+
+# documents failing to compile are fine, only mismatches are of interest.
+check()
+{
+	"$CMFC" -o /dev/null "$1" 2> "$TMP/err"
+	if grep -q mismatch "$TMP/err"
+	then
+		echo "$2:"
+		grep mismatch -A2 "$TMP/err"
+		rc=1
+	fi
+}
+
+rc=0
+for f in examples/*.cmf
+do
+	check "$f" "$f"
+done
+
+for seed in $(seq 1 200)
+do
+	gen_soup "$seed" > "$TMP/soup.cmf"
+	check "$TMP/soup.cmf" "seed $seed"
+done
+
+[ $rc -eq 0 ] && echo "htmlify-check: ok"
+exit $rc
@@ -0,0 +1,227 @@
+// performance fuzzer, looking for markup whose compile time or output grows
+// faster than its size. each input is a short random motif of markup tokens
+// repeated to a small and a large size; a motif is reported if the time per
+// byte of compiling it grows by too much between the two sizes, or if its
+// output expands beyond the bound the library documents. it is built against
+// the library, and compiles inputs in process.
+//
+// usage: perf_fuzz [-n motifs] [-s seed]
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../cmfc.h"
+
+#define SMALL_SIZE 32768
+#define SCALE 8
+#define MAX_RATIO 4.0
+#define MAX_MOTIF 6
+
+// output is expected to stay within this many times the size of the input. the
+// most expansive markup is a few bytes making a title, which is given an id and
+// an entry in the table of contents.
+#define MAX_EXPANSION 32
+
+struct compile_result
+{
+	double secs;
+	size_t out_len;
+	bool ok;
+};
+
+static struct compile_result compile(struct cmfc_opts const *opts, char const *markup, size_t len);
+static void motif_print(char const *motif);
+static size_t repeat(char *buf, char const *motif, size_t size);
+static uint64_t rng(void);
+static int rng_range(int n);
+static int sink_write(void *user, char const *data, size_t len);
+
+// tokens which begin or end blocks and inline markup, along with some text.
+static char const *tokens[] =
+{
+	"*", "#", "=", "\n", "\n\n", "    ", "      ", "```\n", "---", "-----\n", "|",
+	"[^", "]", "@[", "`", "\\", "**", "--", "//", "<", ">", "&", "\"", "'", "a",
+	" ", "DOC-", "[^a]", "[^a|",
+};
+
+static uint64_t rng_state;
+
+int
+main(int argc, char const *argv[])
+{
+	int nmotifs = 200;
+	rng_state = 1;
+	
+	for (int i = 1; i < argc; ++i)
+	{
+		if (!strcmp(argv[i], "-n") && i + 1 < argc)
+			nmotifs = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-s") && i + 1 < argc)
+			rng_state = strtoull(argv[++i], NULL, 10);
+		else
+		{
+			fprintf(stderr, "usage: %s [-n motifs] [-s seed]\n", argv[0]);
+			return 1;
+		}
+	}
+	rng_state = rng_state * 0x9e3779b97f4a7c15ull + 1;
+	
+	char *small = malloc(SMALL_SIZE + 256);
+	char *large = malloc(SMALL_SIZE * SCALE + 256);
+	
+	int nflagged = 0;
+	for (int m = 0; m < nmotifs; ++m)
+	{
+		char motif[256] = {0};
+		for (int t = 1 + rng_range(MAX_MOTIF); t > 0; --t)
+			strcat(motif, tokens[rng_range(sizeof(tokens) / sizeof(tokens[0]))]);
+		
+		// the features which carry state across the document are exercised
+		// too.
+		struct cmfc_opts opts =
+		{
+			.file = "fuzz",
+			.jobs = 1,
+			.renumber_footnotes = rng_range(4) == 0,
+			.toc = rng_range(4) == 0,
+		};
+		
+		size_t small_len = repeat(small, motif, SMALL_SIZE);
+		size_t large_len = repeat(large, motif, SMALL_SIZE * SCALE);
+		
+		// timings are noisy, so a motif only slightly too slow is only reported
+		// if it is slow on a second try as well.
+		double ratio = 0;
+		struct compile_result rs, rl;
+		for (int try = 0; try < 2; ++try)
+		{
+			rs = compile(&opts, small, small_len);
+			rl = compile(&opts, large, large_len);
+			
+			// compiles which fail stop early and say nothing of the rest.
+			if (!rs.ok || !rl.ok)
+				break;
+			
+			double small_secs = rs.secs > 1e-4 ? rs.secs : 1e-4;
+			ratio = rl.secs / large_len / (small_secs / small_len);
+			if (ratio <= MAX_RATIO || ratio > 2 * MAX_RATIO)
+				break;
+		}
+		
+		bool slow = rs.ok && rl.ok && ratio > MAX_RATIO;
+		bool expands = rl.ok && rl.out_len > MAX_EXPANSION * large_len;
+		if (!slow && !expands)
+			continue;
+		
+		++nflagged;
+		printf("%s x%.2f out/in %.1f%s%s: ",
+		       slow ? "SUPERLINEAR" : "EXPANSION",
+		       ratio,
+		       (double)rl.out_len / large_len,
+		       opts.renumber_footnotes ? " -n" : "",
+		       opts.toc ? " -t" : "");
+		motif_print(motif);
+	}
+	
+	printf("%d of %d motifs flagged\n", nflagged, nmotifs);
+	
+	free(small);
+	free(large);
+	
+	return nflagged != 0;
+}
+
+// compile markup three times, keeping the fastest time. slow compiles are only
+// timed once, as noise hardly matters to them.
+static struct compile_result
+compile(struct cmfc_opts const *opts, char const *markup, size_t len)
+{
+	struct compile_result best = {0};
+	for (int run = 0; run < 3; ++run)
+	{
+		struct timespec begin, end;
+		size_t out_len = 0;
+		
+		clock_gettime(CLOCK_MONOTONIC, &begin);
+		int rc = cmfc_compile(opts, markup, len, sink_write, &out_len, NULL);
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		
+		double secs = end.tv_sec - begin.tv_sec + (end.tv_nsec - begin.tv_nsec) / 1e9;
+		if (!run || secs < best.secs)
+		{
+			best = (struct compile_result)
+			{
+				.secs = secs,
+				.out_len = out_len,
+				.ok = rc == CMFC_OK,
+			};
+		}
+		
+		if (secs > 0.1)
+			break;
+	}
+	
+	return best;
+}
+
+static void
+motif_print(char const *motif)
+{
+	putchar('"');
+	for (char const *p = motif; *p; ++p)
+	{
+		if (*p == '\n')
+			printf("\\n");
+		else if (*p == '"' || *p == '\\')
+			printf("\\%c", *p);
+		else
+			putchar(*p);
+	}
+	printf("\"\n");
+}
+
+// write a document of a motif repeated to at least `size` bytes, returning
+// its length. the buffer must hold `size` bytes and some more.
+static size_t
+repeat(char *buf, char const *motif, size_t size)
+{
+	size_t len = sprintf(buf, "DOC-TITLE fuzz\nDOC-CREATED 0\n\n");
+	size_t motif_len = strlen(motif);
+	while (len < size)
+	{
+		size_t n = motif_len < size - len ? motif_len : size - len;
+		memcpy(&buf[len], motif, n);
+		len += n;
+	}
+	buf[len] = 0;
+	
+	return len;
+}
+
+// xorshift64*.
+static uint64_t
+rng(void)
+{
+	rng_state ^= rng_state >> 12;
+	rng_state ^= rng_state << 25;
+	rng_state ^= rng_state >> 27;
+	return rng_state * 0x2545f4914f6cdd1dull;
+}
+
+static int
+rng_range(int n)
+{
+	return rng() % n;
+}
+
+static int
+sink_write(void *user, char const *data, size_t len)
+{
+	*(size_t *)user += len;
+	return 0;
+}
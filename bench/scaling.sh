@@ -0,0 +1,78 @@
+#!/bin/sh
+
+# checks that compile time grows linearly with the size of huge lists and
+# tables, by timing inputs of size n and 8n and comparing the time per item.
+#
+# usage: bench/scaling.sh [cmfc binary]
+
+CMFC=${1:-./cmfc}
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+
+N=100000
+SCALE=8
+MAX_RATIO=3
+
+# generators, each takes the number of items to generate.
+gen_u_list()
+{
+	awk -v n="$1" 'BEGIN { print "DOC-TITLE u_list\n"; for (i = 0; i < n; ++i) print "*" substr("***", 1, i % 4) "item " i }'
+}
+
+gen_o_list()
+{
+	awk -v n="$1" 'BEGIN { print "DOC-TITLE o_list\n"; for (i = 0; i < n; ++i) print "#" substr("###", 1, i % 4) "item " i }'
+}
+
+gen_table_rows()
+{
+	awk -v n="$1" 'BEGIN { print "DOC-TITLE table_rows\n\n-----"; for (i = 0; i < n; ++i) print "|" i "|row|\n-----" }'
+}
+
+gen_table_cont()
+{
+	awk -v n="$1" 'BEGIN { print "DOC-TITLE table_cont\n\n-----"; for (i = 0; i < n; ++i) print "|" i "|continuation|"; print "-----" }'
+}
+
+# prints the best wall-clock time of three runs in microseconds.
+best_time()
+{
+	best=
+	for run in 1 2 3
+	do
+		begin=$(date +%s%N)
+		"$CMFC" -o /dev/null "$1" || exit 1
+		end=$(date +%s%N)
+		t=$(((end - begin) / 1000))
+		if [ -z "$best" ] || [ "$t" -lt "$best" ]
+		then
+			best=$t
+		fi
+	done
+	echo "$best"
+}
+
+rc=0
+for gen in gen_u_list gen_o_list gen_table_rows gen_table_cont
+do
+	$gen $N > "$TMP/small.cmf"
+	$gen $((N * SCALE)) > "$TMP/large.cmf"
+	
+	small=$(best_time "$TMP/small.cmf")
+	large=$(best_time "$TMP/large.cmf")
+	
+	# compare time per item, with a floor to avoid noise on tiny timings.
+	[ "$small" -lt 1000 ] && small=1000
+	ratio=$(awk -v s="$small" -v l="$large" -v k="$SCALE" 'BEGIN { printf "%.2f", l / (s * k) }')
+	
+	verdict=ok
+	if awk -v r="$ratio" -v m="$MAX_RATIO" 'BEGIN { exit !(r > m) }'
+	then
+		verdict=SUPERLINEAR
+		rc=1
+	fi
+	
+	printf "%-16s %8d us  %8d us  x%s  %s\n" "${gen#gen_}" "$small" "$large" "$ratio" "$verdict"
+done
+
+exit $rc
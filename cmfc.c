@@ -1,178 +1,663 @@
 #include <ctype.h>
+#include <errno.h>
+#include <limits.h>
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
+#include <dirent.h>
+#include <fcntl.h>
 #include <getopt.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/inotify.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
 #include <unistd.h>
 
-// text - used for normal textual website data.
-// raw - used for links and URLS.
-#define HS_IS_TEXT(hstate) !HS_IS_RAW(hstate)
-#define HS_IS_RAW(hstate) ((hstate) & (HS_LINK_REF | HS_FORCE_RAW | HS_FOOTNOTE_REF))
-
-enum node_type
-{
-	NT_ROOT = 0,
-	NT_TITLE,
-	NT_PARAGRAPH,
-	NT_U_LIST,
-	NT_O_LIST,
-	NT_LIST_ITEM,
-	NT_IMAGE,
-	NT_BLOCKQUOTE,
-	NT_TABLE,
-	NT_TABLE_ROW,
-	NT_TABLE_ITEM,
-	NT_FOOTNOTE,
-	NT_LONG_CODE,
+#include "cmfc.h"
+
+#define ALIGN_UP(n, align) (((n) + (align) - 1) / (align) * (align))
+
+// build cache entries are single lines beginning with CACHE_MAGIC, followed by
+// the key of the inputs and the size and modification time of the output, and
+// with -z those of its compressed copy.
+#define CACHE_MAGIC "cmfc-cache-1"
+
+// fragment cache files begin with FRAG_MAGIC.
+#define FRAG_MAGIC "cmfcfrg2"
+
+// cached words of documents begin with a line beginning with TERMS_MAGIC.
+#define TERMS_MAGIC "cmfc-terms-1"
+
+// in watch mode, changes are compiled once no further change has been seen for
+// this long, as saving a file may take multiple writes or renames.
+#define WATCH_DEBOUNCE_MS 5
+
+// the compile server refuses requests beyond these sizes. the markup limit may
+// be lowered or raised up to the maximum in its configuration, as may the time
+// a connection may idle before it is closed.
+#define SERVE_MAX_NAME 4096
+#define SERVE_MAX_MARKUP 1073741824
+#define SERVE_DEFAULT_MAX_MARKUP 16777216
+#define SERVE_DEFAULT_IDLE_SECS 30
+
+// number of slowest documents listed in statistics reports.
+#define STATS_TOP 10
+
+// statistics of the last compile of a document, gathered for -T.
+struct doc_stats
+{
+	struct cmfc_stats lib;
+	double secs; // the whole compile, including reading and writing.
+	bool compiled; // false if skipped as up to date.
+	int rc;
+};
+
+// whether outputs are written gzip-compressed, besides or instead of as is.
+enum gzip_mode
+{
+	GM_NONE = 0,
+	GM_ALSO,
+	GM_ONLY,
 };
 
-enum parse_status
+// the contents of an input file, always followed by a null terminator so that
+// the parser may scan up to it.
+struct file_buf
 {
-	PS_OK = 0,
-	PS_ERR,
-	PS_SKIP,
+	char *data;
+	size_t len;
+	size_t map_len; // nonzero if `data` is a file mapping rather than heap memory.
 };
 
-enum htmlify_state
-{
-	HS_NONE = 0x0,
-	HS_LINK_REF = 0x1,
-	HS_LINK_TEXT = 0x2,
-	HS_CODE = 0x4,
-	HS_ITALIC = 0x8,
-	HS_BOLD = 0x10,
-	HS_FORCE_RAW = 0x20,
-	HS_FOOTNOTE_REF = 0x40,
-	HS_FOOTNOTE_TEXT = 0x80,
+struct input
+{
+	char *markup_file;
+	char *rel_name; // name relative to the input root, used for output mapping.
+	char *out_file;
+	struct doc_stats stats;
+	
+	// the distinct words of the document as lines of the word and the number
+	// of times it occurs, sorted by word, if it was last compiled with -I.
+	struct file_buf terms;
 };
 
 struct conf
 {
 	// main configuration data.
-	FILE *markup_fp;
-	char const *markup_file;
-	
-	FILE *out_fp;
 	char const *out_file;
 	
 	FILE *style_fp;
 	char const *style_file;
 	
+	// linked stylesheet configuration data.
+	char const *style_dir;
+	bool style_critical;
+	
 	FILE *docdata_fp;
 	char const *docdata_file;
 	
+	// batch configuration data.
+	struct input *inputs;
+	size_t ninputs;
+	char const *out_dir;
+	int njobs;
+	
+	// incremental build configuration data.
+	char const *cache_dir;
+	
+	// search index configuration data.
+	char const *index_file;
+	
+	// compile server configuration data.
+	char const *listen_path;
+	char const *serve_conf;
+	
+	size_t max_out; // 0 if output is not limited.
+	
+	enum gzip_mode gzip;
+	
 	// configuration flags.
 	bool dump_ast;
+	bool ast_blob;
+	bool renumber;
+	bool heading_ids;
+	bool toc;
+	bool minify;
+	bool batch;
+	bool stream;
+	bool watch;
+	bool stats;
 };
 
 struct file_data
 {
-	char *markup;
-	size_t markup_len;
+	struct file_buf style;
+	struct file_buf docdata;
+	struct cmfc_docdata *base; // state left by the docdata, NULL if there is none.
+	
+	// path the stylesheet was written to, and its critical subset, if it is
+	// linked rather than embedded.
+	char *style_path;
+	char *style_critical;
+	size_t style_critical_len;
+	
+	// hash of everything besides the markup which affects the output, from
+	// which the cache keys of documents are derived.
+	uint64_t hash;
+	
+	// time last spent reading the style and docdata, and parsing the docdata.
+	double read_secs, parse_secs;
+};
+
+// fragment cache files consist of this header followed by the fragments. the
+// text of the fragments is not stored, but read back from the output.
+struct frag_header
+{
+	char magic[8];
+	uint64_t key; // cache key of the compile which produced the output.
 	
-	char *style;
-	size_t style_len;
+	// hash of the options, build and shared files the output was compiled with.
+	// fragments compiled with any others are not reused.
+	uint64_t file_data_hash;
 	
-	char *docdata;
-	size_t docdata_len;
+	uint64_t nfrags;
+};
+
+// the output and fragments of the previous compile of a document, as read back
+// from the build cache.
+struct frag_cache
+{
+	struct file_buf file;
+	struct file_buf out;
+	struct cmfc_prev prev;
+};
+
+// the words of a document being compiled, indexed by an open addressed hash
+// table of word indices plus one.
+struct term_table
+{
+	struct term *terms;
+	size_t nterms, terms_cap;
+	size_t *slots;
+	size_t cap;
+};
+
+struct term
+{
+	char *word;
+	size_t len;
+	uint64_t hash;
+	unsigned long count;
+};
+
+// a position in the words of a document, as they are merged into the search
+// index.
+struct index_cursor
+{
+	char const *word;
+	size_t len;
+	unsigned long count;
+	char const *next, *end;
+	size_t doc;
 };
 
-struct node
+// where the output of a document goes. it is only opened on the first write, so
+// that a failed compile does not clobber a previous good output.
+struct doc_out
 {
-	// how many strings of data are stored depends on the node in question.
-	// e.g. footnotes have two data strings, while paragraphs have one.
-	char *data[2];
+	char const *file; // NULL for standard output.
+	FILE *fp;
 	
-	struct node *children;
-	size_t nchildren;
-	int arg; // type-dependent argument.
-	unsigned char type;
+	// output also passed through a gzip compressor, which writes to an output
+	// of its own, and whether it is only written compressed.
+	struct cmfc_gzip *gz;
+	bool gz_only;
+};
+
+// the markup of a document being streamed.
+struct doc_in
+{
+	char const *file;
+	int fd;
+};
+
+// the inputs to compile, as indices into `conf.inputs`, or NULL for all.
+struct compile_job_arg
+{
+	size_t const *inputs;
+	int *rcs;
+};
+
+// compile requests and replies consist of a header followed by its payload.
+// integers are in host byte order, as the socket is local. a request's payload
+// is the name of a stylesheet, then that of a docdata file, then the markup;
+// empty names select the files given on the command line.
+struct serve_req
+{
+	uint32_t style_len, docdata_len;
+	uint64_t markup_len;
+};
+
+// a reply's payload is the HTML on success, otherwise the diagnostics.
+struct serve_rep
+{
+	uint32_t status;
+	uint32_t pad;
+	uint64_t len;
+};
+
+// a stylesheet or docdata file which requests may name, registered in the
+// server's configuration and loaded before any request is served.
+struct serve_file
+{
+	char *name;
+	bool docdata;
+	struct file_buf buf;
+	struct cmfc_docdata *base; // for docdata, the state it leaves documents in.
+};
+
+// the files are never changed once serving begins, so they are shared by the
+// workers without locking.
+struct serve
+{
+	int fd;
+	struct serve_file *files;
+	size_t nfiles;
+	uint64_t max_markup;
+	unsigned idle_secs;
+};
+
+enum watch_kind
+{
+	WK_MARKUP = 0,
+	WK_STYLE,
+	WK_DOCDATA,
+};
+
+// watched files are matched by name within their watched directory, so that
+// editors which save by renaming over a file are noticed.
+struct watch_file
+{
+	int wd;
+	char *name;
+	unsigned char kind;
+	size_t input; // index into `conf.inputs` of a markup file.
 };
 
-struct doc_data
+struct watch
 {
-	char *title, *subtitle;
-	char *author;
-	char *created, *revised;
-	char *license;
-	char *favicon;
+	int fd;
+	struct watch_file *files;
+	size_t nfiles;
 };
 
+static char *cache_entry_path(char const *out_file);
+static bool cache_lookup(char const *out_file, uint64_t *key);
+static int cache_store(char const *out_file, uint64_t key);
+static int conf_add_arg(char const *arg);
+static int conf_add_dir(char const *dir, char const *rel);
+static void conf_add_input(char *markup_file, char *rel_name);
+static int conf_add_manifest(char const *file);
 static int conf_read(int argc, char const *argv[]);
 static void conf_quit(void);
-static int doc_data_verify(void);
-static char const *entity_char(char ch);
+static int doc_compile(struct input *in);
+static void doc_compile_job(void *arg, size_t job, int worker);
+static int doc_open_markup(struct input const *in);
+static int doc_open_out(struct doc_out *out);
+static int doc_render(struct cmfc_opts const *opts, struct file_buf *markup, struct doc_out *out, struct cmfc_error *err);
+static long doc_read(void *user, char *buf, size_t cap);
+static int doc_write(void *user, char const *data, size_t len);
+static void err_print(FILE *fp, struct cmfc_error const *err);
+static int file_data_prepare(void);
 static int file_data_read(void);
-static void gen_html(void);
-static void gen_blockquote_html(struct node const *node);
-static void gen_footnote_html(struct node const *node);
-static void gen_image_html(struct node const *node);
-static void gen_long_code_html(struct node const *node);
-static void gen_o_list_html(struct node const *node);
-static void gen_paragraph_html(struct node const *node);
-static void gen_table_html(struct node const *node);
-static void gen_title_html(struct node const *node);
-static void gen_u_list_html(struct node const *node);
-static char *htmlified_substr(char const *s, size_t lb, size_t ub, enum htmlify_state hstate);
-static void node_add_child(struct node *node, struct node *child);
-static void node_print(FILE *fp, struct node const *node, int depth);
-static int parse(struct node *out, char const *data, size_t len, char const *file);
-static enum parse_status parse_any(struct node *out, size_t *i, char const *data, size_t len, char const *file);
-static enum parse_status parse_blockquote(struct node *out, size_t *i, char const *data);
-static enum parse_status parse_doc(size_t *i, char const *data, char const *file);
-static enum parse_status parse_footnote(struct node *out, size_t *i, char const *data, size_t len);
-static enum parse_status parse_image(struct node *out, size_t *i, char const *data);
-static enum parse_status parse_long_code(struct node *out, size_t *i, char const *data);
-static enum parse_status parse_o_list(struct node *out, size_t *i, char const *data, size_t len);
-static enum parse_status parse_paragraph(struct node *out, size_t *i, char const *data);
-static enum parse_status parse_table(struct node *out, size_t *i, char const *data, size_t len, char const *file);
-static enum parse_status parse_table_row(struct node *out, size_t *i, char const *data, size_t len, char const *file);
-static enum parse_status parse_title(struct node *out, size_t *i, char const *data, char const *file);
-static enum parse_status parse_u_list(struct node *out, size_t *i, char const *data, size_t len);
-static void prog_err(char const *file, char const *data, size_t start, char const *msg);
-static char const *single_line(char const *s, size_t start);
-static void str_dyn_append_s(char **str, size_t *len, size_t *cap, char const *s);
-static void str_dyn_append_c(char **str, size_t *len, size_t *cap, char c);
+static int file_read(struct file_buf *out, int fd, char const *file, char const *kind);
+static void file_release(struct file_buf *buf);
+static void frag_load(struct frag_cache *fc, char const *out_file);
+static void frag_release(struct frag_cache *fc);
+static int frag_store(char const *out_file, uint64_t key, struct cmfc_frag const *frags, size_t nfrags);
+static bool index_cursor_next(struct index_cursor *ic);
+static void index_sift(struct index_cursor *heap, size_t n, size_t i);
+static void index_word(void *user, char const *word, size_t len);
+static int index_write(void);
+static int input_cmp(void const *a, void const *b);
+static int mkdir_parents(char const *path);
+static char *path_gz_copy(char const *out_file);
+static char *path_join(char const *dir, char const *name);
+static char *path_normalize(char const *path);
+static char *path_relative(char const *from, char const *to);
+static char *path_with_ext(char const *path, char const *ext);
+static double secs_now(void);
+static int serve_conf_read(struct serve *srv, char const *file);
+static void serve_conn(struct serve *srv, int fd);
+static struct serve_file const *serve_file_get(struct serve const *srv, char const *name, bool docdata);
+static int serve_file_load(struct serve_file *sf, char const *path);
+static int serve_recv(int fd, void *buf, size_t n);
+static void serve_release(struct serve *srv);
+static int serve_run(void);
+static int serve_send(int fd, void const *buf, size_t n);
+static int serve_send_err(int fd, char const *msg, size_t len);
+static void *serve_worker(void *arg);
+static int serve_write(void *user, char const *data, size_t len);
+static int stats_cmp(void const *a, void const *b);
+static void stats_print(FILE *fp, struct doc_stats const *ds);
+static void stats_report(size_t const *inputs, size_t ninputs, double secs);
+static bool str_has_suffix(char const *s, char const *suffix);
+static void str_print_json(FILE *fp, char const *s, size_t len);
+static void style_minify(struct file_buf *style);
+static int style_write(void);
+static int term_cmp(void const *a, void const *b);
+static void term_table_release(struct term_table *tt);
+static void terms_dump(struct term_table *tt, struct file_buf *out);
+static bool terms_load(struct input *in, uint64_t key);
+static int terms_store(char const *out_file, uint64_t key, struct file_buf const *terms);
 static void usage(char const *name);
+static size_t utf8_len(char const *s, size_t len);
+static int word_cmp(char const *a, size_t a_len, char const *b, size_t b_len);
+static int watch_add(struct watch *w, char const *path, enum watch_kind kind, size_t input);
+static void watch_release(struct watch *w);
+static int watch_run(void);
 
 static struct conf conf;
-static struct doc_data doc_data;
-static struct node doc_root;
 static struct file_data file_data;
-static bool raw_text = false;
 
 int
 main(int argc, char const *argv[])
 {
+	double start = secs_now();
+	
 	if (conf_read(argc, argv))
 		return 1;
 	
 	if (file_data_read())
 		return 1;
 	
-	if (conf.docdata_file)
+	if (file_data_prepare())
+		return 1;
+	
+	if (conf.listen_path)
+		return serve_run();
+	
+	int *rcs = calloc(conf.ninputs, sizeof(int));
+	struct compile_job_arg arg =
+	{
+		.rcs = rcs,
+	};
+	cmfc_pool_run(conf.ninputs, conf.njobs, doc_compile_job, &arg);
+	
+	int rc = 0;
+	for (size_t i = 0; i < conf.ninputs; ++i)
+		rc |= rcs[i];
+	
+	free(rcs);
+	
+	if (conf.index_file && index_write())
+		rc = 1;
+	
+	if (conf.stats)
+		stats_report(NULL, conf.ninputs, secs_now() - start);
+	
+	// errors are only reported while watching, as they are expected to be
+	// fixed by further edits.
+	if (conf.watch)
+		return watch_run();
+	
+	return rc;
+}
+
+static int
+conf_add_dir(char const *dir, char const *rel)
+{
+	DIR *dp = opendir(dir);
+	if (!dp)
+	{
+		fprintf(stderr, "err: failed to open input directory: %s!\n", dir);
+		return 1;
+	}
+	
+	size_t first = conf.ninputs;
+	
+	struct dirent *ent;
+	while ((ent = readdir(dp)))
+	{
+		if (!strcmp(ent->d_name, ".") || !strcmp(ent->d_name, ".."))
+			continue;
+		
+		char *path = path_join(dir, ent->d_name);
+		char *sub_rel = rel ? path_join(rel, ent->d_name) : strdup(ent->d_name);
+		
+		// entries which cannot be statted, e.g. dangling links such as editor
+		// lock files, are skipped rather than failing the batch.
+		struct stat st;
+		bool link = false;
+		if (lstat(path, &st) || ((link = S_ISLNK(st.st_mode)) && stat(path, &st)))
+		{
+			fprintf(stderr, "warn: skipping input file which cannot be statted: %s!\n", path);
+			free(path);
+			free(sub_rel);
+			continue;
+		}
+		
+		// linked directories are not followed, as they may loop.
+		if (S_ISDIR(st.st_mode) && !link)
+		{
+			int rc = conf_add_dir(path, sub_rel);
+			free(path);
+			free(sub_rel);
+			if (rc)
+			{
+				closedir(dp);
+				return 1;
+			}
+		}
+		else if (!S_ISDIR(st.st_mode) && str_has_suffix(ent->d_name, ".cmf"))
+			conf_add_input(path, sub_rel);
+		else
+		{
+			free(path);
+			free(sub_rel);
+		}
+	}
+	
+	closedir(dp);
+	
+	// readdir order is arbitrary, sort so that batch runs are reproducible.
+	if (!rel)
+		qsort(&conf.inputs[first], conf.ninputs - first, sizeof(struct input), input_cmp);
+	
+	return 0;
+}
+
+// cache entries are named after a hash of the output path they describe.
+static char *
+cache_entry_path(char const *out_file)
+{
+	char name[17];
+	sprintf(name, "%016llx", (unsigned long long)cmfc_hash(CMFC_HASH_INIT, out_file, strlen(out_file)));
+	return path_join(conf.cache_dir, name);
+}
+
+// find the key of the inputs an output was last built from, provided that the
+// output, and its compressed copy if any, have not been touched since.
+static bool
+cache_lookup(char const *out_file, uint64_t *key)
+{
+	char *entry_path = cache_entry_path(out_file);
+	FILE *fp = fopen(entry_path, "rb");
+	free(entry_path);
+	if (!fp)
+		return false;
+	
+	char magic[32];
+	unsigned long long entry_key, sizes[2];
+	long long mtime_secs[2], mtime_nsecs[2];
+	int nread = fscanf(fp,
+	                   "%31s %llx %llu %lld %lld %llu %lld %lld",
+	                   magic,
+	                   &entry_key,
+	                   &sizes[0],
+	                   &mtime_secs[0],
+	                   &mtime_nsecs[0],
+	                   &sizes[1],
+	                   &mtime_secs[1],
+	                   &mtime_nsecs[1]);
+	fclose(fp);
+	
+	int nfiles = conf.gzip == GM_ALSO ? 2 : 1;
+	if (nread != 2 + 3 * nfiles || strcmp(magic, CACHE_MAGIC))
+		return false;
+	
+	char *gz_file = path_gz_copy(out_file);
+	char const *files[] = {out_file, gz_file};
+	bool valid = true;
+	for (int i = 0; i < nfiles && valid; ++i)
+	{
+		struct stat st;
+		valid = !stat(files[i], &st)
+			&& st.st_size == sizes[i]
+			&& st.st_mtim.tv_sec == mtime_secs[i]
+			&& st.st_mtim.tv_nsec == mtime_nsecs[i];
+	}
+	free(gz_file);
+	
+	if (valid)
+		*key = entry_key;
+	return valid;
+}
+
+static int
+cache_store(char const *out_file, uint64_t key)
+{
+	char *gz_file = path_gz_copy(out_file);
+	char const *files[] = {out_file, gz_file};
+	int nfiles = conf.gzip == GM_ALSO ? 2 : 1;
+	struct stat st[2];
+	for (int i = 0; i < nfiles; ++i)
 	{
-		if (parse(NULL, file_data.docdata, file_data.docdata_len, conf.docdata_file))
+		if (stat(files[i], &st[i]))
+		{
+			fprintf(stderr, "err: failed to stat output file: %s!\n", files[i]);
+			free(gz_file);
 			return 1;
+		}
+	}
+	free(gz_file);
+	
+	char *entry_path = cache_entry_path(out_file);
+	if (mkdir_parents(entry_path))
+	{
+		free(entry_path);
+		return 1;
 	}
 	
-	if (parse(&doc_root, file_data.markup, file_data.markup_len, conf.markup_file))
+	// entries are replaced atomically so that an interrupted build never
+	// leaves behind a valid-looking entry.
+	char *tmp_path = path_with_ext(entry_path, ".tmp");
+	FILE *fp = fopen(tmp_path, "wb");
+	if (!fp)
+	{
+		fprintf(stderr, "err: failed to open cache entry for writing: %s!\n", tmp_path);
+		free(tmp_path);
+		free(entry_path);
 		return 1;
+	}
+	
+	fprintf(fp, "%s %016llx", CACHE_MAGIC, (unsigned long long)key);
+	for (int i = 0; i < nfiles; ++i)
+	{
+		fprintf(fp,
+		        " %llu %lld %lld",
+		        (unsigned long long)st[i].st_size,
+		        (long long)st[i].st_mtim.tv_sec,
+		        (long long)st[i].st_mtim.tv_nsec);
+	}
+	fputc('\n', fp);
+	
+	int rc = 0;
+	if (fclose(fp) || rename(tmp_path, entry_path))
+	{
+		fprintf(stderr, "err: failed to write cache entry: %s!\n", entry_path);
+		remove(tmp_path);
+		rc = 1;
+	}
+	
+	free(tmp_path);
+	free(entry_path);
+	
+	return rc;
+}
+
+static int
+conf_add_arg(char const *arg)
+{
+	struct stat st;
+	if (!stat(arg, &st) && S_ISDIR(st.st_mode))
+	{
+		conf.batch = true;
+		return conf_add_dir(arg, NULL);
+	}
 	
-	if (doc_data_verify())
+	char const *base = strrchr(arg, '/');
+	conf_add_input(strdup(arg), strdup(base ? base + 1 : arg));
+	
+	return 0;
+}
+
+static void
+conf_add_input(char *markup_file, char *rel_name)
+{
+	conf.inputs = reallocarray(conf.inputs, conf.ninputs + 1, sizeof(struct input));
+	conf.inputs[conf.ninputs++] = (struct input)
+	{
+		.markup_file = markup_file,
+		.rel_name = rel_name,
+	};
+}
+
+static int
+conf_add_manifest(char const *file)
+{
+	FILE *fp = strcmp(file, "-") ? fopen(file, "rb") : stdin;
+	if (!fp)
+	{
+		fprintf(stderr, "err: failed to open manifest file for reading: %s!\n", file);
 		return 1;
+	}
 	
-	if (conf.dump_ast)
+	// each non-empty line of the manifest names a single input.
+	char *line = NULL;
+	size_t line_cap = 0;
+	ssize_t line_len;
+	while ((line_len = getline(&line, &line_cap, fp)) != -1)
 	{
-		node_print(conf.out_fp, &doc_root, 0);
-		return 0;
+		while (line_len > 0 && strchr("\r\n", line[line_len - 1]))
+			line[--line_len] = 0;
+		
+		if (!line_len)
+			continue;
+		
+		if (conf_add_arg(line))
+		{
+			free(line);
+			if (fp != stdin)
+				fclose(fp);
+			return 1;
+		}
 	}
 	
-	gen_html();
+	free(line);
+	if (fp != stdin)
+		fclose(fp);
 	
 	return 0;
 }
@@ -182,15 +667,37 @@ conf_read(int argc, char const *argv[])
 {
 	atexit(conf_quit);
 	
+	static struct option const long_opts[] =
+	{
+		{"minify", no_argument, NULL, 'x'},
+		{"stats", no_argument, NULL, 'T'},
+		{0},
+	};
+	
 	// get option arguments.
 	int c;
-	while ((c = getopt(argc, (char *const *)argv, "Ad:ho:s:")) != -1)
+	while ((c = getopt_long(argc, (char *const *)argv, "ABC:cd:HhI:j:L:l:M:m:nO:o:r:Ss:TtwxZz", long_opts, NULL)) != -1)
 	{
 		switch (c)
 		{
 		case 'A':
 			conf.dump_ast = true;
 			break;
+		case 'B':
+			conf.ast_blob = true;
+			break;
+		case 'C':
+			if (conf.cache_dir)
+			{
+				fprintf(stderr, "err: cannot specify multiple cache directories!\n");
+				return 1;
+			}
+			
+			conf.cache_dir = optarg;
+			break;
+		case 'c':
+			conf.style_critical = true;
+			break;
 		case 'd':
 			if (conf.docdata_fp)
 			{
@@ -206,25 +713,118 @@ conf_read(int argc, char const *argv[])
 				return 1;
 			}
 			
+			break;
+		case 'H':
+			conf.heading_ids = true;
 			break;
 		case 'h':
 			usage(argv[0]);
 			exit(0);
+		case 'I':
+			if (conf.index_file)
+			{
+				fprintf(stderr, "err: cannot specify multiple search indices!\n");
+				return 1;
+			}
+			
+			conf.index_file = optarg;
+			break;
+		case 'L':
+			if (conf.style_dir)
+			{
+				fprintf(stderr, "err: cannot specify multiple stylesheet directories!\n");
+				return 1;
+			}
+			
+			conf.style_dir = optarg;
+			break;
+		case 'l':
+			if (conf.listen_path)
+			{
+				fprintf(stderr, "err: cannot specify multiple sockets to listen on!\n");
+				return 1;
+			}
+			
+			conf.listen_path = optarg;
+			break;
+		case 'j':
+			conf.njobs = atoi(optarg);
+			if (conf.njobs < 1)
+			{
+				fprintf(stderr, "err: expected a positive number of jobs: %s!\n", optarg);
+				return 1;
+			}
+			
+			break;
+		case 'M':
+			conf.max_out = strtoull(optarg, NULL, 10);
+			if (!conf.max_out)
+			{
+				fprintf(stderr, "err: expected a positive number of bytes: %s!\n", optarg);
+				return 1;
+			}
+			
+			break;
+		case 'm':
+			conf.batch = true;
+			if (conf_add_manifest(optarg))
+				return 1;
+			break;
+		case 'n':
+			conf.renumber = true;
+			break;
+		case 'r':
+			if (conf.serve_conf)
+			{
+				fprintf(stderr, "err: cannot specify multiple serve config files!\n");
+				return 1;
+			}
+			
+			conf.serve_conf = optarg;
+			break;
+		case 'O':
+			if (conf.out_dir)
+			{
+				fprintf(stderr, "err: cannot specify multiple output directories!\n");
+				return 1;
+			}
+			
+			conf.batch = true;
+			conf.out_dir = optarg;
+			break;
 		case 'o':
-			if (conf.out_fp)
+			if (conf.out_file)
 			{
 				fprintf(stderr, "err: cannot specify multiple output files!\n");
 				return 1;
 			}
 			
 			conf.out_file = optarg;
-			conf.out_fp = fopen(optarg, "wb");
-			if (!conf.out_fp)
+			break;
+		case 'S':
+			conf.stream = true;
+			break;
+		case 'T':
+			conf.stats = true;
+			break;
+		case 't':
+			conf.toc = true;
+			break;
+		case 'w':
+			conf.watch = true;
+			break;
+		case 'x':
+			conf.minify = true;
+			break;
+		case 'Z':
+		case 'z':
+			if (conf.gzip)
 			{
-				fprintf(stderr, "err: failed to open output file for writing: %s!\n", optarg);
+				fprintf(stderr, "err: cannot specify both -Z and -z!\n");
 				return 1;
 			}
 			
+			conf.gzip = c == 'Z' ? GM_ONLY : GM_ALSO;
 			break;
 		case 's':
 			if (conf.style_fp)
@@ -250,1240 +850,1847 @@ conf_read(int argc, char const *argv[])
 	
 	// get non-option arguments.
 	{
-		if (optind != argc - 1)
+		for (int i = optind; i < argc; ++i)
+		{
+			if (conf_add_arg(argv[i]))
+				return 1;
+		}
+		
+		if (argc - optind > 1)
+			conf.batch = true;
+		
+		if (conf.serve_conf && !conf.listen_path)
 		{
-			fprintf(stderr, "err: expected a single non-option argument!\n");
+			fprintf(stderr, "err: cannot read a serve config without serving, use -l!\n");
 			return 1;
 		}
 		
-		conf.markup_file = argv[argc - 1];
-		conf.markup_fp = fopen(argv[argc - 1], "rb");
-		if (!conf.markup_fp)
+		if (conf.listen_path && conf.ninputs)
 		{
-			fprintf(stderr, "err: failed to open markup file for reading: %s!\n", argv[argc - 1]);
+			fprintf(stderr, "err: cannot compile markup files when serving!\n");
 			return 1;
 		}
-	}
-	
-	// set unset default configuration.
-	{
-		if (!conf.out_fp)
+		
+		if (conf.ast_blob && (conf.dump_ast || conf.stream || conf.listen_path))
 		{
-			conf.out_file = "stdout";
-			conf.out_fp = stdout;
+			fprintf(stderr, "err: cannot write binary ASTs when dumping, streaming or serving!\n");
+			return 1;
 		}
-	}
-	
-	return 0;
-}
-
-static void
-conf_quit(void)
-{
-	// close opened files.
-	{
-		if (conf.markup_fp)
-			fclose(conf.markup_fp);
 		
-		if (conf.out_fp)
-			fclose(conf.out_fp);
+		if (conf.toc && conf.stream)
+		{
+			fprintf(stderr, "err: cannot generate a table of contents when streaming!\n");
+			return 1;
+		}
 		
-		if (conf.style_fp)
-			fclose(conf.style_fp);
-	}
-}
-
-static int
-doc_data_verify(void)
-{
-	// check for presence of all necessary data.
-	{
-		if (!doc_data.title)
+		if (conf.index_file && (conf.dump_ast || conf.ast_blob || conf.listen_path))
 		{
-			fprintf(stderr, "err: document missing a title!\n");
+			fprintf(stderr, "err: cannot write a search index when dumping, writing binary ASTs or serving!\n");
 			return 1;
 		}
 		
-		if (doc_data.revised && !doc_data.created)
+		if (conf.listen_path && conf.stats)
 		{
-			fprintf(stderr, "err: document missing a creation date, only revision provided!\n");
+			fprintf(stderr, "err: cannot report statistics when serving!\n");
 			return 1;
 		}
-	}
-	
-	return 0;
-}
-
-static char const *
-entity_char(char ch)
-{
-	switch (ch)
-	{
-	case '<':
-		return "&lt;";
-	case '>':
-		return "&gt;";
-	case '&':
-		return "&amp;";
-	case '"':
-		return "&quot;";
-	case '\'':
-		return "&apos;";
-	
-	default:
-		return NULL;
-	}
-}
-
-static int
-file_data_read(void)
-{
-	// read markup file.
-	{
-		fseek(conf.markup_fp, 0, SEEK_END);
-		long len = ftell(conf.markup_fp);
-		if (len == -1)
+		
+		if (conf.listen_path && conf.gzip)
 		{
-			fprintf(stderr, "err: failed to get size of markup file: %s!\n", conf.markup_file);
+			fprintf(stderr, "err: cannot compress output when serving!\n");
 			return 1;
 		}
-		fseek(conf.markup_fp, 0, SEEK_SET);
 		
-		file_data.markup_len = len;
-		file_data.markup = calloc(len + 1, sizeof(char));
-		if (fread(file_data.markup, sizeof(char), len, conf.markup_fp) != len)
+		if (conf.style_dir && !conf.style_file)
 		{
-			fprintf(stderr, "err: failed to read markup file: %s!\n", conf.markup_file);
+			fprintf(stderr, "err: cannot link to a stylesheet without one, use -s!\n");
 			return 1;
 		}
-	}
-	
-	// read style file.
-	if (conf.style_fp)
-	{
-		fseek(conf.style_fp, 0, SEEK_END);
-		long len = ftell(conf.style_fp);
-		if (len == -1)
+		
+		if (conf.style_critical && !conf.style_dir)
+		{
+			fprintf(stderr, "err: cannot embed the critical stylesheet without linking to it, use -L!\n");
+			return 1;
+		}
+		
+		if (conf.listen_path && conf.style_dir)
 		{
-			fprintf(stderr, "err: failed to get size of style file: %s!\n", conf.style_file);
+			fprintf(stderr, "err: cannot link to a stylesheet when serving!\n");
 			return 1;
 		}
-		fseek(conf.style_fp, 0, SEEK_SET);
 		
-		file_data.style_len = len;
-		file_data.style = calloc(len + 1, sizeof(char));
-		if (fread(file_data.style, sizeof(char), len, conf.style_fp) != len)
+		if (!conf.ninputs && !conf.listen_path)
 		{
-			fprintf(stderr, "err: failed to read style file: %s!\n", conf.style_file);
+			fprintf(stderr, "err: expected at least one markup file!\n");
 			return 1;
 		}
 	}
 	
-	// read docdata file.
-	if (conf.docdata_fp)
+	// set unset default configuration.
+	{
+		if (!conf.njobs)
+			conf.njobs = sysconf(_SC_NPROCESSORS_ONLN) > 0 ? sysconf(_SC_NPROCESSORS_ONLN) : 1;
+	}
+	
+	// map inputs to outputs.
 	{
-		fseek(conf.docdata_fp, 0, SEEK_END);
-		long len = ftell(conf.docdata_fp);
-		if (len == -1)
+		if (conf.batch && conf.out_file)
+		{
+			fprintf(stderr, "err: cannot specify an output file for multiple inputs, use -O!\n");
+			return 1;
+		}
+		
+		if (conf.gzip == GM_ALSO && !conf.batch && !conf.out_file)
 		{
-			fprintf(stderr, "err: failed to get size of docdata file: %s!\n", conf.docdata_file);
+			fprintf(stderr, "err: cannot write a compressed copy of standard output, use -Z!\n");
 			return 1;
 		}
-		fseek(conf.docdata_fp, 0, SEEK_SET);
 		
-		file_data.docdata_len = len;
-		file_data.docdata = calloc(len + 1, sizeof(char));
-		if (fread(file_data.docdata, sizeof(char), len, conf.docdata_fp) != len)
+		if (conf.index_file && !conf.batch && !conf.out_file)
 		{
-			fprintf(stderr, "err: failed to read docdata file: %s!\n", conf.docdata_file);
+			fprintf(stderr, "err: cannot index a document written to standard output, use -o!\n");
 			return 1;
 		}
+		
+		char const *ext = conf.ast_blob ? ".cmfb" : ".html";
+		if (conf.gzip == GM_ONLY)
+			ext = conf.ast_blob ? ".cmfb.gz" : ".html.gz";
+		for (size_t i = 0; i < conf.ninputs; ++i)
+		{
+			struct input *in = &conf.inputs[i];
+			
+			if (!conf.batch)
+				in->out_file = conf.out_file ? strdup(conf.out_file) : NULL;
+			else if (conf.out_dir)
+			{
+				char *name = path_join(conf.out_dir, in->rel_name);
+				in->out_file = path_with_ext(name, ext);
+				free(name);
+			}
+			else
+				in->out_file = path_with_ext(in->markup_file, ext);
+		}
 	}
 	
 	return 0;
 }
 
 static void
-gen_html(void)
+conf_quit(void)
 {
-	// write out preamble, head, header document data.
+	// close opened files.
 	{
-		fprintf(conf.out_fp,
-		        "<!DOCTYPE html>\n"
-		        "<html>\n"
-		        "<head>\n"
-		        "<meta charset=\"UTF-8\">\n"
-		        "<title>%s</title>\n",
-		        doc_data.title);
-		
-		if (conf.style_file)
-			fprintf(conf.out_fp, "<style>%s</style>\n", file_data.style);
-		
-		if (doc_data.favicon)
-			fprintf(conf.out_fp, "<link rel=\"icon\" type=\"image/x-icon\" href=\"%s\">\n", doc_data.favicon);
-		
-		// write out author.
-		if (doc_data.author)
-			fprintf(conf.out_fp, "<div class=\"doc-author\">%s</div>\n", doc_data.author);
-		
-		// write out creation / revision date.
-		{
-			if (doc_data.created)
-				fprintf(conf.out_fp, "<div class=\"doc-date\">%s", doc_data.created);
-			if (doc_data.revised)
-				fprintf(conf.out_fp, " (rev. %s)", doc_data.revised);
-			if (doc_data.created)
-				fprintf(conf.out_fp, "</div>\n");
-		}
-		
-		fprintf(conf.out_fp, "<div class=\"doc-title\">%s</div>\n", doc_data.title);
-		
-		if (doc_data.subtitle)
-			fprintf(conf.out_fp, "<div class=\"doc-subtitle\">%s</div>\n", doc_data.subtitle);
+		if (conf.style_fp)
+			fclose(conf.style_fp);
 		
-		fprintf(conf.out_fp,
-		        "</head>\n"
-		        "<body>\n");
+		if (conf.docdata_fp)
+			fclose(conf.docdata_fp);
+	}
+}
+
+static int
+doc_compile(struct input *in)
+{
+	in->stats = (struct doc_stats){0};
+	file_release(&in->terms);
+	
+	int markup_fd = doc_open_markup(in);
+	if (markup_fd == -1)
+		return 1;
+	
+	int rc = 1;
+	
+	struct cmfc_opts opts =
+	{
+		.file = in->markup_file,
+		.style = conf.style_file ? file_data.style.data : NULL,
+		.style_len = file_data.style.len,
+		.docdata = file_data.base,
+		.jobs = conf.ninputs == 1 ? conf.njobs : 1,
+		.dump_ast = conf.dump_ast,
+		.renumber_footnotes = conf.renumber,
+		.heading_ids = conf.heading_ids,
+		.toc = conf.toc,
+		.minify = conf.minify,
+		.max_out = conf.max_out,
+		.stats = conf.stats ? &in->stats.lib : NULL,
+	};
+	
+	// a linked stylesheet is found relative to the output, and only its
+	// critical subset, if anything, is embedded.
+	char *style_href = NULL;
+	if (conf.style_dir)
+	{
+		style_href = path_relative(in->out_file, file_data.style_path);
+		opts.style = file_data.style_critical;
+		opts.style_len = file_data.style_critical_len;
+		opts.style_href = style_href;
+	}
+	
+	// the words of the document are counted as it is generated.
+	struct term_table terms = {0};
+	if (conf.index_file)
+	{
+		opts.word = index_word;
+		opts.word_user = &terms;
+	}
+	
+	struct doc_out out =
+	{
+		.file = in->out_file,
+		.gz_only = conf.gzip == GM_ONLY,
+	};
+	struct cmfc_error err;
+	int crc;
+	
+	struct file_buf markup = {0};
+	struct cmfc_frag *frags = NULL;
+	size_t nfrags = 0;
+	
+	// compressed output replaces the output with -Z, and goes next to it
+	// with -z.
+	char *gz_file = NULL;
+	if (conf.gzip == GM_ALSO)
+	{
+		gz_file = path_gz_copy(in->out_file);
 	}
 	
-	// write out document contents.
+	struct doc_out gz_out =
+	{
+		.file = conf.gzip == GM_ALSO ? gz_file : in->out_file,
+	};
+	if (conf.gzip)
+		out.gz = cmfc_gzip_new(doc_write, &gz_out);
+	
+	// streamed and piped documents are not cached, as their markup is not
+	// known until it has been compiled.
+	bool cached = conf.cache_dir && in->out_file && !conf.stream && strcmp(in->markup_file, "-");
+	uint64_t cache_key = 0;
+	
+	if (conf.stream)
+	{
+		struct doc_in din =
+		{
+			.file = in->markup_file,
+			.fd = markup_fd,
+		};
+		crc = cmfc_stream(&opts, doc_read, &din, doc_write, &out, &err);
+	}
+	else
 	{
-		for (size_t i = 0; i < doc_root.nchildren; ++i)
+		if (file_read(&markup, markup_fd, in->markup_file, "markup"))
+			goto done;
+		
+		// skip documents whose output is already up to date, leaving it
+		// untouched.
+		if (cached)
 		{
-			switch (doc_root.children[i].type)
+			cache_key = cmfc_hash(file_data.hash, &markup.len, sizeof(markup.len));
+			cache_key = cmfc_hash(cache_key, markup.data, markup.len);
+			
+			// its words must have been cached too if it is indexed.
+			uint64_t prev_key;
+			if (cache_lookup(in->out_file, &prev_key)
+			    && prev_key == cache_key
+			    && (!conf.index_file || terms_load(in, cache_key)))
 			{
-			case NT_TITLE:
-				gen_title_html(&doc_root.children[i]);
-				break;
-			case NT_PARAGRAPH:
-				gen_paragraph_html(&doc_root.children[i]);
-				break;
-			case NT_U_LIST:
-				gen_u_list_html(&doc_root.children[i]);
-				break;
-			case NT_O_LIST:
-				gen_o_list_html(&doc_root.children[i]);
-				break;
-			case NT_IMAGE:
-				gen_image_html(&doc_root.children[i]);
-				break;
-			case NT_BLOCKQUOTE:
-				gen_blockquote_html(&doc_root.children[i]);
-				break;
-			case NT_TABLE:
-				gen_table_html(&doc_root.children[i]);
-				break;
-			case NT_FOOTNOTE:
-				gen_footnote_html(&doc_root.children[i]);
-				break;
-			case NT_LONG_CODE:
-				gen_long_code_html(&doc_root.children[i]);
-				break;
+				cached = false;
+				rc = 0;
+				goto done;
 			}
 		}
-	}
-	
-	// write out postamble, footer document data.
-	{
-		if (doc_data.license)
-			fprintf(conf.out_fp, "<div class=\"doc-license\">%s</div>", doc_data.license);
 		
-		fprintf(conf.out_fp,
-		        "</body>\n"
-		        "</html>\n");
+		// binary ASTs are rendered without parsing. cached documents which
+		// changed are rebuilt from the fragments of their unchanged blocks
+		// where possible, unless only their compressed output was kept. the
+		// previous output is no longer read by the time it is overwritten.
+		if (cmfc_is_ast(markup.data, markup.len))
+			crc = doc_render(&opts, &markup, &out, &err);
+		else if (conf.ast_blob)
+			crc = cmfc_serialize(&opts, markup.data, markup.len, doc_write, &out, &err);
+		else if (cached && conf.gzip != GM_ONLY)
+		{
+			struct frag_cache prev;
+			frag_load(&prev, in->out_file);
+			crc = cmfc_compile_incremental(&opts,
+			                               markup.data,
+			                               markup.len,
+			                               &prev.prev,
+			                               &frags,
+			                               &nfrags,
+			                               doc_write,
+			                               &out,
+			                               &err);
+			frag_release(&prev);
+		}
+		else
+			crc = cmfc_compile(&opts, markup.data, markup.len, doc_write, &out, &err);
 	}
+	
+	if (crc == CMFC_ERR)
+		err_print(stderr, &err);
+	
+	in->stats.compiled = true;
+	rc = crc != CMFC_OK;
+	
+	if (!rc && out.gz && cmfc_gzip_finish(out.gz))
+		rc = 1;
+	
+	if (!rc && conf.index_file)
+		terms_dump(&terms, &in->terms);
+	
+done:
+	if (markup_fd != STDIN_FILENO)
+		close(markup_fd);
+	
+	if (out.fp && out.fp != stdout)
+		fclose(out.fp);
+	
+	cmfc_gzip_free(out.gz);
+	if (gz_out.fp && gz_out.fp != stdout)
+		fclose(gz_out.fp);
+	free(gz_file);
+	
+	// the entry can only be made once the output is closed and its final
+	// modification time known. it is written last, as it vouches for the
+	// fragments and words as well as the output.
+	if (!rc && cached && frag_store(in->out_file, cache_key, frags, nfrags))
+		rc = 1;
+	
+	if (!rc && cached && conf.index_file && terms_store(in->out_file, cache_key, &in->terms))
+		rc = 1;
+	
+	if (!rc && cached && cache_store(in->out_file, cache_key))
+		rc = 1;
+	
+	file_release(&markup);
+	free(frags);
+	free(style_href);
+	term_table_release(&terms);
+	
+	return rc;
 }
 
 static void
-gen_blockquote_html(struct node const *node)
+doc_compile_job(void *arg, size_t job, int worker)
 {
-	fprintf(conf.out_fp, "<blockquote>%s</blockquote>\n", node->data[0]);
+	struct compile_job_arg const *cja = arg;
+	struct input *in = &conf.inputs[cja->inputs ? cja->inputs[job] : job];
+	
+	double start = conf.stats ? secs_now() : 0;
+	cja->rcs[job] = doc_compile(in);
+	
+	in->stats.secs = conf.stats ? secs_now() - start : 0;
+	in->stats.rc = cja->rcs[job];
 }
 
-static void
-gen_footnote_html(struct node const *node)
+static int
+doc_open_markup(struct input const *in)
 {
-	fprintf(conf.out_fp, "<div class=\"footnote\" id=\"%s\">%s</div>\n", node->data[0], node->data[1]);
+	int fd = strcmp(in->markup_file, "-") ? open(in->markup_file, O_RDONLY) : STDIN_FILENO;
+	if (fd == -1)
+		fprintf(stderr, "err: failed to open markup file for reading: %s!\n", in->markup_file);
+	
+	return fd;
 }
 
-static void
-gen_image_html(struct node const *node)
+static int
+doc_open_out(struct doc_out *out)
 {
-	fprintf(conf.out_fp, "<img src=\"%s\">\n", node->data[0]);
+	if (!out->file)
+	{
+		out->fp = stdout;
+		return 0;
+	}
+	
+	if (conf.batch && mkdir_parents(out->file))
+		return 1;
+	
+	out->fp = fopen(out->file, "wb");
+	if (!out->fp)
+	{
+		fprintf(stderr, "err: failed to open output file for writing: %s!\n", out->file);
+		return 1;
+	}
+	
+	return 0;
 }
 
-static void
-gen_long_code_html(struct node const *node)
+static long
+doc_read(void *user, char *buf, size_t cap)
 {
-	fprintf(conf.out_fp, "<div class=\"long-code\">%s</div>\n", node->data[0]);
+	struct doc_in const *in = user;
+	
+	for (;;)
+	{
+		ssize_t nread = read(in->fd, buf, cap);
+		if (nread == -1 && errno == EINTR)
+			continue;
+		
+		if (nread == -1)
+			fprintf(stderr, "err: failed to read markup file: %s!\n", in->file);
+		
+		return nread;
+	}
 }
 
-static void
-gen_o_list_html(struct node const *node)
+// render a binary AST in place of markup. mapped files are mapped privately, so
+// making them writable for loading leaves the file itself untouched.
+static int
+doc_render(struct cmfc_opts const *opts, struct file_buf *markup, struct doc_out *out, struct cmfc_error *err)
 {
-	int cur_depth = 0;
-	for (size_t i = 0; i < node->nchildren; ++i)
+	if (conf.ast_blob)
 	{
-		int dd = node->children[i].arg - cur_depth;
-		while (dd > 0)
-		{
-			fprintf(conf.out_fp, "<ol>\n");
-			--dd;
-		}
-		while (dd < 0)
-		{
-			fprintf(conf.out_fp, "</ol>\n");
-			++dd;
-		}
-		
-		fprintf(conf.out_fp, "<li>%s</li>\n", node->children[i].data[0]);
-		
-		cur_depth = node->children[i].arg;
+		fprintf(stderr, "err: markup file is already a binary AST: %s!\n", opts->file);
+		return CMFC_ERR_IO;
 	}
 	
-	while (cur_depth > 0)
+	if (markup->map_len && mprotect(markup->data, markup->map_len, PROT_READ | PROT_WRITE))
 	{
-		fprintf(conf.out_fp, "</ol>\n");
-		--cur_depth;
+		fprintf(stderr, "err: failed to map markup file: %s!\n", opts->file);
+		return CMFC_ERR_IO;
 	}
+	
+	struct cmfc_ast *ast = cmfc_ast_load(markup->data, markup->len, opts->file, err);
+	if (!ast)
+		return CMFC_ERR;
+	
+	int rc = cmfc_ast_render(opts, ast, doc_write, out, err);
+	cmfc_ast_free(ast);
+	
+	return rc;
 }
 
-static void
-gen_paragraph_html(struct node const *node)
-{
-	fprintf(conf.out_fp, "<p>%s</p>\n", node->data[0]);
-}
-
-static void
-gen_table_html(struct node const *node)
+static int
+doc_write(void *user, char const *data, size_t len)
 {
-	fprintf(conf.out_fp, "<table>\n");
-	for (size_t row = 0; row < node->nchildren; ++row)
+	struct doc_out *out = user;
+	
+	if (out->gz && cmfc_gzip_write(out->gz, data, len))
+		return 1;
+	
+	if (out->gz_only)
+		return 0;
+	
+	if (!out->fp && doc_open_out(out))
+		return 1;
+	
+	if (fwrite(data, sizeof(char), len, out->fp) != len || fflush(out->fp))
 	{
-		fprintf(conf.out_fp, "<tr>\n");
-		for (size_t col = 0; col < node->children[row].nchildren; ++col)
-		{
-			fprintf(conf.out_fp,
-			        "<td>%s</td>\n",
-			        node->children[row].children[col].data[0]);
-		}
-		fprintf(conf.out_fp, "</tr>\n");
+		fprintf(stderr, "err: failed to write output file: %s!\n", out->file ? out->file : "stdout");
+		return 1;
 	}
-	fprintf(conf.out_fp, "</table>\n");
+	
+	return 0;
 }
 
+// diagnostics are written with a single call so that messages from
+// concurrently compiled documents do not interleave.
 static void
-gen_title_html(struct node const *node)
+err_print(FILE *fp, struct cmfc_error const *err)
 {
-	fprintf(conf.out_fp, "<h%d>%s</h%d>\n", node->arg, node->data[0], node->arg);
+	int len = cmfc_error_format(NULL, 0, err);
+	char *buf = malloc(len + 1);
+	cmfc_error_format(buf, len + 1, err);
+	fputs(buf, fp);
+	free(buf);
 }
 
-static void
-gen_u_list_html(struct node const *node)
+// derive the state shared by all documents from the style and docdata.
+static int
+file_data_prepare(void)
 {
-	int cur_depth = 0;
-	for (size_t i = 0; i < node->nchildren; ++i)
+	// derive the basis of document cache keys. any rebuild of the compiler
+	// invalidates the build cache, as its output may differ.
+	if (conf.cache_dir)
 	{
-		int dd = node->children[i].arg - cur_depth;
-		while (dd > 0)
-		{
-			fprintf(conf.out_fp, "<ul>\n");
-			--dd;
-		}
-		while (dd < 0)
+		uint64_t h = cmfc_hash(CMFC_HASH_INIT, cmfc_version(), strlen(cmfc_version()));
+		h = cmfc_hash(h, &conf.dump_ast, sizeof(conf.dump_ast));
+		h = cmfc_hash(h, &conf.ast_blob, sizeof(conf.ast_blob));
+		h = cmfc_hash(h, &conf.renumber, sizeof(conf.renumber));
+		h = cmfc_hash(h, &conf.heading_ids, sizeof(conf.heading_ids));
+		h = cmfc_hash(h, &conf.toc, sizeof(conf.toc));
+		h = cmfc_hash(h, &conf.minify, sizeof(conf.minify));
+		h = cmfc_hash(h, &conf.max_out, sizeof(conf.max_out));
+		h = cmfc_hash(h, &conf.gzip, sizeof(conf.gzip));
+		h = cmfc_hash(h, &conf.style_critical, sizeof(conf.style_critical));
+		if (conf.style_dir)
+			h = cmfc_hash(h, conf.style_dir, strlen(conf.style_dir) + 1);
+		h = cmfc_hash(h, &file_data.style.len, sizeof(file_data.style.len));
+		h = cmfc_hash(h, file_data.style.data, file_data.style.len);
+		h = cmfc_hash(h, &file_data.docdata.len, sizeof(file_data.docdata.len));
+		h = cmfc_hash(h, file_data.docdata.data, file_data.docdata.len);
+		file_data.hash = h;
+	}
+	
+	if (conf.style_dir && style_write())
+		return 1;
+	
+	// every document starts from the state left by the docdata.
+	cmfc_docdata_free(file_data.base);
+	file_data.base = NULL;
+	if (conf.docdata_file)
+	{
+		struct cmfc_error err;
+		double start = secs_now();
+		file_data.base = cmfc_docdata_new(file_data.docdata.data, file_data.docdata.len, conf.docdata_file, &err);
+		file_data.parse_secs = secs_now() - start;
+		if (!file_data.base)
 		{
-			fprintf(conf.out_fp, "</ul>\n");
-			++dd;
+			err_print(stderr, &err);
+			return 1;
 		}
+	}
+	
+	return 0;
+}
+
+static int
+file_data_read(void)
+{
+	double start = secs_now();
+	
+	// read style file.
+	if (conf.style_fp)
+	{
+		if (file_read(&file_data.style, fileno(conf.style_fp), conf.style_file, "style"))
+			return 1;
 		
-		fprintf(conf.out_fp, "<li>%s</li>\n", node->children[i].data[0]);
-		
-		cur_depth = node->children[i].arg;
+		if (conf.minify)
+			style_minify(&file_data.style);
 	}
 	
-	while (cur_depth > 0)
+	// read docdata file.
+	if (conf.docdata_fp)
 	{
-		fprintf(conf.out_fp, "</ul>\n");
-		--cur_depth;
+		if (file_read(&file_data.docdata, fileno(conf.docdata_fp), conf.docdata_file, "docdata"))
+			return 1;
 	}
+	
+	file_data.read_secs = secs_now() - start;
+	
+	return 0;
 }
 
-static char *
-htmlified_substr(char const *s, size_t lb, size_t ub, enum htmlify_state hstate)
+// regular files are mapped and parsed in place rather than copied onto the
+// heap. anything else, e.g. pipes, falls back to buffered reads.
+static int
+file_read(struct file_buf *out, int fd, char const *file, char const *kind)
 {
-	char *sub = calloc(1, sizeof(char));
-	size_t slen = 0, scap = 1;
+	*out = (struct file_buf){0};
 	
-	for (size_t i = lb; i < ub; ++i)
+	struct stat st;
+	if (fstat(fd, &st))
 	{
-		if (raw_text)
-		{
-			str_dyn_append_c(&sub, &slen, &scap, s[i]);
-			continue;
-		}
-		else if (i + 1 < ub && s[i] == '\\')
-		{
-			++i;
-			
-			if (HS_IS_TEXT(hstate) && entity_char(s[i]))
-				str_dyn_append_s(&sub, &slen, &scap, entity_char(s[i]));
-			else if (HS_IS_RAW(hstate) && s[i] == '"')
-				str_dyn_append_s(&sub, &slen, &scap, "%22");
-			else
-				str_dyn_append_c(&sub, &slen, &scap, s[i]);
-			
-			continue;
-		}
-		else if (HS_IS_TEXT(hstate)
-		         && i + 1 < ub
-		         && !strncmp(&s[i], "@[", 2))
-		{
-			++i;
-			str_dyn_append_s(&sub, &slen, &scap, "<a href=\"");
-			hstate |= HS_LINK_REF;
-			continue;
-		}
-		else if (HS_IS_TEXT(hstate)
-		         && i + 1 < ub
-		         && !strncmp(&s[i], "[^", 2))
-		{
-			++i;
-			str_dyn_append_s(&sub, &slen, &scap, "<sup><a href=\"#");
-			hstate |= HS_FOOTNOTE_REF;
-			continue;
-		}
-		else if (hstate & HS_LINK_REF && s[i] == '|')
+		fprintf(stderr, "err: failed to get size of %s file: %s!\n", kind, file);
+		return 1;
+	}
+	
+	// map regular files, except in resident processes. a file truncated while
+	// it is mapped raises SIGBUS, which is only acceptable when it kills a one
+	// off build, not a watcher or server which would keep running otherwise.
+	if (S_ISREG(st.st_mode) && st.st_size > 0 && !conf.watch && !conf.listen_path)
+	{
+		// the kernel zero-fills the rest of the last page of a mapping, which
+		// serves as the null terminator. if the file ends exactly on a page
+		// boundary there is no such rest, so an extra page of anonymous zero
+		// memory is reserved after it and the file is mapped over the front.
+		size_t page = sysconf(_SC_PAGESIZE);
+		size_t len = st.st_size;
+		size_t map_len = ALIGN_UP(len + 1, page);
+		
+		char *data = mmap(NULL, map_len, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (data == MAP_FAILED)
 		{
-			hstate &= ~HS_LINK_REF;
-			hstate |= HS_LINK_TEXT;
-			str_dyn_append_s(&sub, &slen, &scap, "\">");
-			continue;
+			fprintf(stderr, "err: failed to map %s file: %s!\n", kind, file);
+			return 1;
 		}
-		else if (hstate & HS_LINK_TEXT && s[i] == ']')
+		
+		if (mmap(data, ALIGN_UP(len, page), PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED)
 		{
-			hstate &= ~HS_LINK_TEXT;
-			str_dyn_append_s(&sub, &slen, &scap, "</a>");
-			continue;
+			munmap(data, map_len);
+			fprintf(stderr, "err: failed to map %s file: %s!\n", kind, file);
+			return 1;
 		}
-		else if (hstate & HS_FOOTNOTE_REF && s[i] == '|')
+		
+		madvise(data, map_len, MADV_SEQUENTIAL);
+		
+		*out = (struct file_buf)
 		{
-			hstate &= ~HS_FOOTNOTE_REF;
-			hstate |= HS_FOOTNOTE_TEXT;
-			str_dyn_append_s(&sub, &slen, &scap, "\">[");
-			continue;
-		}
-		else if (hstate & HS_FOOTNOTE_TEXT && s[i] == ']')
+			.data = data,
+			.len = len,
+			.map_len = map_len,
+		};
+		
+		return 0;
+	}
+	
+	// read anything else.
+	size_t cap = S_ISREG(st.st_mode) ? st.st_size + 2 : 65536;
+	out->data = malloc(cap);
+	for (;;)
+	{
+		if (out->len + 1 >= cap)
 		{
-			hstate &= ~HS_FOOTNOTE_TEXT;
-			str_dyn_append_s(&sub, &slen, &scap, "]</a></sup>");
-			continue;
+			cap *= 2;
+			out->data = realloc(out->data, cap);
 		}
-		else if (HS_IS_TEXT(hstate) && s[i] == '`')
-		{
-			if (hstate & HS_CODE)
-			{
-				hstate &= ~HS_CODE;
-				str_dyn_append_s(&sub, &slen, &scap, "</code>");
-			}
-			else
-			{
-				hstate |= HS_CODE;
-				str_dyn_append_s(&sub, &slen, &scap, "<code>");
-			}
+		
+		ssize_t nread = read(fd, &out->data[out->len], cap - out->len - 1);
+		if (nread == -1 && errno == EINTR)
 			continue;
-		}
-		else if (HS_IS_TEXT(hstate)
-		         && i + 1 < ub
-		         && !strncmp(&s[i], "**", 2))
+		
+		if (nread == -1)
 		{
-			++i;
-			if (hstate & HS_BOLD)
-			{
-				hstate &= ~HS_BOLD;
-				str_dyn_append_s(&sub, &slen, &scap, "</b>");
-			}
-			else
-			{
-				hstate |= HS_BOLD;
-				str_dyn_append_s(&sub, &slen, &scap, "<b>");
-			}
-			continue;
+			fprintf(stderr, "err: failed to read %s file: %s!\n", kind, file);
+			file_release(out);
+			return 1;
 		}
-		else if (HS_IS_TEXT(hstate) && s[i] == '*')
-		{
-			if (hstate & HS_ITALIC)
-			{
-				hstate &= ~HS_ITALIC;
-				str_dyn_append_s(&sub, &slen, &scap, "</i>");
-			}
-			else
-			{
-				hstate |= HS_ITALIC;
-				str_dyn_append_s(&sub, &slen, &scap, "<i>");
-			}
-			continue;
-		}
-		else if (HS_IS_TEXT(hstate) && entity_char(s[i]))
-		{
-			str_dyn_append_s(&sub, &slen, &scap, entity_char(s[i]));
-			continue;
-		}
-		else if (HS_IS_RAW(hstate) && s[i] == '"')
-		{
-			str_dyn_append_s(&sub, &slen, &scap, "%22");
-			continue;
-		}
-		else if (HS_IS_TEXT(hstate) && i + 2 < ub && !strncmp(&s[i], "---", 3))
-		{
-			str_dyn_append_s(&sub, &slen, &scap, "&mdash;");
-			i += 2;
-			continue;
-		}
-		else if (HS_IS_TEXT(hstate) && i + 1 < ub && !strncmp(&s[i], "--", 2))
-		{
-			str_dyn_append_s(&sub, &slen, &scap, "&ndash;");
-			++i;
-			continue;
-		}
-		else if (HS_IS_TEXT(hstate) && i + 1 < ub && !strncmp(&s[i], "//", 2))
-		{
-			str_dyn_append_s(&sub, &slen, &scap, "<br>");
-			++i;
-			continue;
-		}
-		
-		// if not special, just add the character.
-		{
-			str_dyn_append_c(&sub, &slen, &scap, s[i]);
-		}
-	}
-	
-	// terminate any unterminated HTMLify states.
-	{
-		if (hstate & HS_LINK_REF)
-			str_dyn_append_s(&sub, &slen, &scap, "\"></a>");
-		else if (hstate & HS_LINK_TEXT)
-			str_dyn_append_s(&sub, &slen, &scap, "</a>");
 		
-		if (hstate & HS_FOOTNOTE_REF)
-			str_dyn_append_s(&sub, &slen, &scap, "\">[]</a></sup>");
-		else if (hstate & HS_FOOTNOTE_TEXT)
-			str_dyn_append_s(&sub, &slen, &scap, "]</a></sup>");
+		if (nread == 0)
+			break;
 		
-		if (hstate & HS_CODE)
-			str_dyn_append_s(&sub, &slen, &scap, "</code>");
-		if (hstate & HS_ITALIC)
-			str_dyn_append_s(&sub, &slen, &scap, "</i>");
-		if (hstate & HS_BOLD)
-			str_dyn_append_s(&sub, &slen, &scap, "</b>");
+		out->len += nread;
 	}
+	out->data[out->len] = 0;
 	
-	return sub;
+	return 0;
 }
 
 static void
-node_add_child(struct node *node, struct node *child)
+file_release(struct file_buf *buf)
 {
-	++node->nchildren;
-	node->children = reallocarray(node->children, node->nchildren, sizeof(struct node));
-	node->children[node->nchildren - 1] = *child;
+	if (buf->map_len)
+		munmap(buf->data, buf->map_len);
+	else
+		free(buf->data);
+	
+	*buf = (struct file_buf){0};
 }
 
+// a missing or stale fragment cache is not an error, it just holds nothing.
+// fragments are only valid alongside the output they were cut from, which must
+// be untouched since, and for compiles with the same options, compiler build,
+// stylesheet and docdata.
 static void
-node_print(FILE *fp, struct node const *node, int depth)
+frag_load(struct frag_cache *fc, char const *out_file)
 {
-	// pad out appropriate depth.
-	{
-		for (int i = 0; i < depth; ++i)
-			fprintf(fp, "  ");
-	}
+	*fc = (struct frag_cache){0};
+	
+	uint64_t key;
+	if (!cache_lookup(out_file, &key))
+		return;
+	
+	char *entry_path = cache_entry_path(out_file);
+	char *path = path_with_ext(entry_path, ".frags");
+	free(entry_path);
 	
-	// write out node information.
+	int fd = open(path, O_RDONLY);
+	int read_rc = fd == -1 || file_read(&fc->file, fd, path, "fragment cache");
+	if (fd != -1)
+		close(fd);
+	free(path);
+	if (read_rc)
+		return;
+	
+	fd = open(out_file, O_RDONLY);
+	read_rc = fd == -1 || file_read(&fc->out, fd, out_file, "output");
+	if (fd != -1)
+		close(fd);
+	if (read_rc)
+		return;
+	
+	// the file may be truncated or stale. fragments outside the output are
+	// left to the library to reject.
+	struct frag_header const *hdr = (struct frag_header const *)fc->file.data;
+	if (fc->file.len < sizeof(struct frag_header)
+		|| memcmp(hdr->magic, FRAG_MAGIC, sizeof(hdr->magic))
+		|| hdr->key != key
+		|| hdr->file_data_hash != file_data.hash
+		|| hdr->nfrags != (fc->file.len - sizeof(struct frag_header)) / sizeof(struct cmfc_frag))
 	{
-		static char const *type_lut[] =
-		{
-			"NT_ROOT",
-			"NT_TITLE",
-			"NT_PARAGRAPH",
-			"NT_U_LIST",
-			"NT_O_LIST",
-			"NT_LIST_ITEM",
-			"NT_IMAGE",
-			"NT_BLOCKQUOTE",
-			"NT_TABLE",
-			"NT_TABLE_ROW",
-			"NT_TABLE_ITEM",
-			"NT_FOOTNOTE",
-			"NT_LONG_CODE",
-		};
-		
-		fprintf(fp, "%s: %d", type_lut[node->type], node->arg);
-		for (size_t i = 0; i < sizeof(node->data) / sizeof(char *); ++i)
-		{
-			if (node->data[i])
-				fprintf(fp, " %s", node->data[i]);
-		}
-		fprintf(fp, "\n");
+		return;
 	}
 	
-	// recursively print out children.
+	fc->prev = (struct cmfc_prev)
 	{
-		for (size_t i = 0; i < node->nchildren; ++i)
-			node_print(fp, &node->children[i], depth + 1);
-	}
+		.out = fc->out.data,
+		.out_len = fc->out.len,
+		.frags = (struct cmfc_frag const *)&fc->file.data[sizeof(struct frag_header)],
+		.nfrags = hdr->nfrags,
+	};
+}
+
+static void
+frag_release(struct frag_cache *fc)
+{
+	file_release(&fc->file);
+	file_release(&fc->out);
 }
 
 static int
-parse(struct node *out, char const *data, size_t len, char const *file)
+frag_store(char const *out_file, uint64_t key, struct cmfc_frag const *frags, size_t nfrags)
 {
-	if (out)
+	char *entry_path = cache_entry_path(out_file);
+	char *path = path_with_ext(entry_path, ".frags");
+	char *tmp_path = path_with_ext(path, ".tmp");
+	free(entry_path);
+	
+	int rc = 1;
+	
+	if (mkdir_parents(path))
+		goto done;
+	
+	FILE *fp = fopen(tmp_path, "wb");
+	if (!fp)
 	{
-		*out = (struct node)
-		{
-			.type = NT_ROOT,
-		};
+		fprintf(stderr, "err: failed to open fragment cache for writing: %s!\n", tmp_path);
+		goto done;
 	}
 	
-	for (size_t i = 0; i < len;)
+	struct frag_header hdr =
 	{
-		struct node child;
-		enum parse_status rc = parse_any(out ? &child : NULL, &i, data, len, file);
-		switch (rc)
-		{
-		case PS_OK:
-			if (out)
-				node_add_child(out, &child);
-			break;
-		case PS_ERR:
-			return 1;
-		case PS_SKIP:
-			break;
-		}
-	}
+		.key = key,
+		.file_data_hash = file_data.hash,
+		.nfrags = nfrags,
+	};
+	memcpy(hdr.magic, FRAG_MAGIC, sizeof(hdr.magic));
 	
-	return 0;
-}
-
-static enum parse_status
-parse_any(struct node *out,
-          size_t *i,
-          char const *data,
-          size_t len,
-          char const *file)
-{
-	if (!strncmp("DOC", &data[*i], 3))
-		return parse_doc(i, data, file);
-	else if (data[*i] == '=')
-		return parse_title(out, i, data, file);
-	else if (data[*i] == '*')
-		return parse_u_list(out, i, data, len);
-	else if (data[*i] == '#')
-		return parse_o_list(out, i, data, len);
-	else if (!strncmp("      ", &data[*i], 6))
-		return parse_blockquote(out, i, data);
-	else if (!strncmp("```\n", &data[*i], 4))
-		return parse_long_code(out, i, data);
-	else if (!strncmp("---", &data[*i], 3))
-		return parse_table(out, i, data, len, file);
-	else if (!strncmp("!()", &data[*i], 3))
-		return parse_image(out, i, data);
-	else if (!strncmp("[^", &data[*i], 2))
-		return parse_footnote(out, i, data, len);
-	else if (data[*i] != '\n')
-		return parse_paragraph(out, i, data);
-	else
+	fwrite(&hdr, sizeof(hdr), 1, fp);
+	if (nfrags)
+		fwrite(frags, sizeof(struct cmfc_frag), nfrags, fp);
+	
+	int err = ferror(fp);
+	if (fclose(fp) || err || rename(tmp_path, path))
 	{
-		++*i;
-		return PS_SKIP;
+		fprintf(stderr, "err: failed to write fragment cache: %s!\n", path);
+		remove(tmp_path);
+		goto done;
 	}
+	
+	rc = 0;
+	
+done:
+	free(tmp_path);
+	free(path);
+	
+	return rc;
 }
 
-static enum parse_status
-parse_blockquote(struct node *out, size_t *i, char const *data)
+// move to the next word of a document, returning false past the last.
+static bool
+index_cursor_next(struct index_cursor *ic)
 {
-	*i += 6;
-	size_t begin = *i;
-	while (data[*i] && strncmp("\n\n", &data[*i], 2))
-		++*i;
+	if (ic->next >= ic->end)
+		return false;
 	
-	if (out)
-	{
-		*out = (struct node)
-		{
-			.type = NT_BLOCKQUOTE,
-		};
-		out->data[0] = htmlified_substr(data, begin, *i, HS_NONE);
-	}
+	char *count_end;
+	ic->word = ic->next;
+	ic->len = strchr(ic->word, ' ') - ic->word;
+	ic->count = strtoul(&ic->word[ic->len + 1], &count_end, 10);
+	ic->next = count_end + 1;
 	
-	return PS_OK;
+	return true;
 }
 
-static enum parse_status
-parse_doc(size_t *i, char const *data, char const *file)
+// restore the order of a heap of cursors, by word and then by document, below
+// the cursor at `i`.
+static void
+index_sift(struct index_cursor *heap, size_t n, size_t i)
 {
-	if (!strncmp("DOC-TITLE ", &data[*i], 10))
-	{
-		if (doc_data.title)
-			free(doc_data.title);
-		
-		*i += 10;
-		size_t begin = *i;
-		while (data[*i] && data[*i] != '\n')
-			++*i;
-		
-		doc_data.title = htmlified_substr(data, begin, *i, HS_NONE);
-	}
-	else if (!strncmp("DOC-SUBTITLE ", &data[*i], 13))
-	{
-		if (doc_data.subtitle)
-			free(doc_data.subtitle);
-		
-		*i += 13;
-		size_t begin = *i;
-		while (data[*i] && data[*i] != '\n')
-			++*i;
-		
-		doc_data.subtitle = htmlified_substr(data, begin, *i, HS_NONE);
-	}
-	else if (!strncmp("DOC-AUTHOR ", &data[*i], 11))
-	{
-		if (doc_data.author)
-			free(doc_data.author);
-		
-		*i += 11;
-		size_t begin = *i;
-		while (data[*i] && data[*i] != '\n')
-			++*i;
-		
-		doc_data.author = htmlified_substr(data, begin, *i, HS_NONE);
-	}
-	else if (!strncmp("DOC-CREATED ", &data[*i], 12))
-	{
-		if (doc_data.created)
-			free(doc_data.created);
-		
-		*i += 12;
-		size_t begin = *i;
-		while (data[*i] && data[*i] != '\n')
-			++*i;
-		
-		doc_data.created = htmlified_substr(data, begin, *i, HS_NONE);
-	}
-	else if (!strncmp("DOC-REVISED ", &data[*i], 12))
-	{
-		if (doc_data.revised)
-			free(doc_data.revised);
-		
-		*i += 12;
-		size_t begin = *i;
-		while (data[*i] && data[*i] != '\n')
-			++*i;
-		
-		doc_data.revised = htmlified_substr(data, begin, *i, HS_NONE);
-	}
-	else if (!strncmp("DOC-LICENSE ", &data[*i], 12))
+	for (;;)
 	{
-		if (doc_data.license)
-			free(doc_data.license);
+		size_t min = i;
+		for (size_t c = 2 * i + 1; c <= 2 * i + 2 && c < n; ++c)
+		{
+			int cmp = word_cmp(heap[c].word, heap[c].len, heap[min].word, heap[min].len);
+			if (cmp < 0 || (!cmp && heap[c].doc < heap[min].doc))
+				min = c;
+		}
 		
-		*i += 12;
-		size_t begin = *i;
-		while (data[*i] && data[*i] != '\n')
-			++*i;
+		if (min == i)
+			return;
 		
-		doc_data.license = htmlified_substr(data, begin, *i, HS_NONE);
+		struct index_cursor tmp = heap[i];
+		heap[i] = heap[min];
+		heap[min] = tmp;
+		i = min;
 	}
-	else if (!strncmp("DOC-FAVICON ", &data[*i], 12))
+}
+
+// count a word of a document being compiled.
+static void
+index_word(void *user, char const *word, size_t len)
+{
+	struct term_table *tt = user;
+	uint64_t hash = cmfc_hash(CMFC_HASH_INIT, word, len);
+	
+	// the table is kept at most half full. the low bits of the hash are weak,
+	// so the high bits are folded into them.
+	if (2 * (tt->nterms + 1) > tt->cap)
 	{
-		if (doc_data.favicon)
-			free(doc_data.favicon);
-		
-		*i += 12;
-		size_t begin = *i;
-		while (data[*i] && data[*i] != '\n')
-			++*i;
-		
-		doc_data.favicon = htmlified_substr(data, begin, *i, HS_NONE);
+		tt->cap = tt->cap ? 2 * tt->cap : 256;
+		free(tt->slots);
+		tt->slots = calloc(tt->cap, sizeof(size_t));
+		for (size_t t = 0; t < tt->nterms; ++t)
+		{
+			size_t i = (tt->terms[t].hash ^ tt->terms[t].hash >> 32) & (tt->cap - 1);
+			while (tt->slots[i])
+				i = (i + 1) & (tt->cap - 1);
+			tt->slots[i] = t + 1;
+		}
 	}
-	else if (!strncmp("DOC-RAW-TEXT ", &data[*i], 13))
+	
+	size_t mask = tt->cap - 1, i;
+	for (i = (hash ^ hash >> 32) & mask; tt->slots[i]; i = (i + 1) & mask)
 	{
-		*i += 13;
-		if (!data[*i] || !strchr("01", data[*i]))
+		struct term *t = &tt->terms[tt->slots[i] - 1];
+		if (t->hash == hash && t->len == len && !memcmp(t->word, word, len))
 		{
-			prog_err(file, data, *i, "expected 0 or 1 after DOC-RAW-TEXT!");
-			return PS_ERR;
+			++t->count;
+			return;
 		}
-		
-		raw_text = data[*i] - '0';
-		
-		while (data[*i] && data[*i] != '\n')
-			++*i;
 	}
-	else
+	
+	if (tt->nterms >= tt->terms_cap)
 	{
-		prog_err(file, data, *i, "unknown DOC directive!");
-		return PS_ERR;
+		tt->terms_cap = tt->terms_cap ? 2 * tt->terms_cap : 256;
+		tt->terms = reallocarray(tt->terms, tt->terms_cap, sizeof(struct term));
 	}
 	
-	return PS_SKIP;
+	tt->terms[tt->nterms] = (struct term)
+	{
+		.word = strndup(word, len),
+		.len = len,
+		.hash = hash,
+		.count = 1,
+	};
+	tt->slots[i] = ++tt->nterms;
 }
 
-static enum parse_status
-parse_footnote(struct node *out, size_t *i, char const *data, size_t len)
+// write the search index of every document with words, merging their sorted
+// words so that the index is written in order of word without being held in
+// memory. the index replaces any previous one atomically.
+static int
+index_write(void)
 {
-	char *name;
+	char *tmp_path = path_with_ext(conf.index_file, ".tmp");
+	FILE *fp = fopen(tmp_path, "wb");
+	if (!fp)
 	{
-		*i += 2;
-		size_t begin = *i;
-		while (data[*i] && data[*i] != ']')
-		{
-			if (*i + 1 < len && data[*i] == '\\')
-				++*i;
-			++*i;
-		}
-		
-		name = htmlified_substr(data, begin, *i, HS_FORCE_RAW);
+		fprintf(stderr, "err: failed to open search index for writing: %s!\n", tmp_path);
+		free(tmp_path);
+		return 1;
 	}
 	
-	char *text;
+	// documents are numbered in the order they are listed, and linked to
+	// relative to the index.
+	struct index_cursor *heap = malloc((conf.ninputs + 1) * sizeof(struct index_cursor));
+	size_t nheap = 0, ndocs = 0;
+	
+	fprintf(fp, "{\"docs\":[");
+	for (size_t i = 0; i < conf.ninputs; ++i)
 	{
-		++*i;
-		size_t begin = *i;
-		while (data && strncmp("\n\n", &data[*i], 2))
+		struct input const *in = &conf.inputs[i];
+		if (!in->terms.data)
+			continue;
+		
+		char *href = path_relative(conf.index_file, in->out_file);
+		fprintf(fp, ndocs ? ",\n" : "\n");
+		str_print_json(fp, href, strlen(href));
+		free(href);
+		
+		heap[nheap] = (struct index_cursor)
 		{
-			++*i;
-		}
+			.next = in->terms.data,
+			.end = &in->terms.data[in->terms.len],
+			.doc = ndocs++,
+		};
+		if (index_cursor_next(&heap[nheap]))
+			++nheap;
+	}
+	
+	fprintf(fp, "\n],\n\"terms\":{");
+	for (size_t n = nheap / 2; n > 0; --n)
+		index_sift(heap, nheap, n - 1);
+	
+	bool first = true;
+	while (nheap)
+	{
+		char const *word = heap[0].word;
+		size_t len = heap[0].len;
+		fprintf(fp, "%s\n", first ? "" : "],");
+		str_print_json(fp, word, len);
+		fputs(":[", fp);
+		first = false;
 		
-		text = htmlified_substr(data, begin, *i, HS_NONE);
+		// the postings of a word are its documents and its number of
+		// occurrences in each, flattened into pairs.
+		for (bool first_doc = true; nheap && !word_cmp(heap[0].word, heap[0].len, word, len); first_doc = false)
+		{
+			fprintf(fp, "%s%zu,%lu", first_doc ? "" : ",", heap[0].doc, heap[0].count);
+			if (!index_cursor_next(&heap[0]))
+				heap[0] = heap[--nheap];
+			index_sift(heap, nheap, 0);
+		}
 	}
 	
-	if (out)
+	fprintf(fp, "%s\n}}\n", first ? "" : "]");
+	free(heap);
+	
+	int rc = 0;
+	int err = ferror(fp);
+	if (fclose(fp) || err || rename(tmp_path, conf.index_file))
 	{
-		*out = (struct node)
-		{
-			.type = NT_FOOTNOTE,
-		};
-		out->data[0] = name;
-		out->data[1] = text;
+		fprintf(stderr, "err: failed to write search index: %s!\n", conf.index_file);
+		remove(tmp_path);
+		rc = 1;
 	}
 	
-	return PS_OK;
+	free(tmp_path);
+	
+	return rc;
 }
 
-static enum parse_status
-parse_image(struct node *out, size_t *i, char const *data)
+static int
+input_cmp(void const *a, void const *b)
 {
-	*i += 3;
-	size_t begin = *i;
-	while (data[*i] && data[*i] != '\n')
-		++*i;
-	
-	if (out)
+	struct input const *in_a = a, *in_b = b;
+	return strcmp(in_a->markup_file, in_b->markup_file);
+}
+
+static int
+mkdir_parents(char const *path)
+{
+	char *dir = strdup(path);
+	for (char *p = strchr(dir + 1, '/'); p; p = strchr(p + 1, '/'))
 	{
-		*out = (struct node)
+		*p = 0;
+		if (mkdir(dir, 0755) && errno != EEXIST)
 		{
-			.type = NT_IMAGE,
-		};
-		out->data[0] = htmlified_substr(data, begin, *i, HS_FORCE_RAW);
+			fprintf(stderr, "err: failed to create output directory: %s!\n", dir);
+			free(dir);
+			return 1;
+		}
+		*p = '/';
 	}
 	
-	return PS_OK;
+	free(dir);
+	return 0;
 }
 
-static enum parse_status
-parse_long_code(struct node *out, size_t *i, char const *data)
+// the compressed copy of an output written with -z.
+static char *
+path_gz_copy(char const *out_file)
 {
-	*i += 4;
-	size_t begin = *i;
-	while (data[*i] && strncmp(&data[*i], "\n```\n", 4))
-		++*i;
-	
-	if (out)
-	{
-		*out = (struct node)
-		{
-			.type = NT_LONG_CODE,
-		};
-		out->data[0] = htmlified_substr(data, begin, *i, HS_NONE);
-	}
+	char *gz_file = malloc(strlen(out_file) + 4);
+	sprintf(gz_file, "%s.gz", out_file);
+	return gz_file;
+}
+
+static char *
+path_join(char const *dir, char const *name)
+{
+	size_t dir_len = strlen(dir), name_len = strlen(name);
+	while (dir_len > 1 && dir[dir_len - 1] == '/')
+		--dir_len;
 	
-	if (data[*i])
-		*i += 4;
+	char *path = malloc(dir_len + name_len + 2);
+	memcpy(path, dir, dir_len);
+	path[dir_len] = '/';
+	memcpy(&path[dir_len + 1], name, name_len + 1);
 	
-	return PS_OK;
+	return path;
 }
 
-static enum parse_status
-parse_o_list(struct node *out, size_t *i, char const *data, size_t len)
+// make a path absolute, resolving `.` and `..` components and removing
+// repeated slashes. this is done lexically, without following symbolic links.
+// the root directory is the empty string.
+static char *
+path_normalize(char const *path)
 {
-	if (out)
+	char *full;
+	if (path[0] == '/')
+		full = strdup(path);
+	else
 	{
-		*out = (struct node)
-		{
-			.type = NT_O_LIST,
-		};
+		char *cwd = getcwd(NULL, 0);
+		full = path_join(cwd ? cwd : "/", path);
+		free(cwd);
 	}
 	
-	for (;;)
+	size_t len = 0;
+	for (char const *p = full; *p;)
 	{
-		int depth = 0;
-		while (data[*i] == '#')
-		{
-			++*i;
-			++depth;
-		}
+		while (*p == '/')
+			++p;
 		
-		size_t begin = *i;
-		while (data[*i]
-		       && strncmp("\n\n", &data[*i], 2)
-		       && strncmp("\n#", &data[*i], 2))
+		size_t n = strcspn(p, "/");
+		if (n == 2 && !strncmp(p, "..", 2))
 		{
-			++*i;
+			while (len && full[--len] != '/')
+				;
 		}
-		
-		if (out)
+		else if (n && !(n == 1 && *p == '.'))
 		{
-			struct node item =
-			{
-				.type = NT_LIST_ITEM,
-				.arg = depth,
-			};
-			item.data[0] = htmlified_substr(data, begin, *i, HS_NONE);
-			node_add_child(out, &item);
+			// components only ever move back, so this is done in place.
+			full[len++] = '/';
+			memmove(&full[len], p, n);
+			len += n;
 		}
 		
-		++*i;
-		if (*i >= len || data[*i] == '\n')
-			break;
+		p += n;
 	}
+	full[len] = 0;
 	
-	return PS_OK;
+	return full;
 }
 
-static enum parse_status
-parse_paragraph(struct node *out, size_t *i, char const *data)
+// path of `to` relative to the directory of the file `from`, or to the working
+// directory if `from` is NULL.
+static char *
+path_relative(char const *from, char const *to)
 {
-	*i += 4 * !strncmp("    ", &data[*i], 4);
-	size_t begin = *i;
-	while (data[*i]
-	       && strncmp("\n\n", &data[*i], 2)
-	       && strncmp("\n    ", &data[*i], 5))
-	{
-		++*i;
-	}
+	char *from_dir = path_normalize(from ? from : "."), *to_abs = path_normalize(to);
+	if (from)
+		*strrchr(from_dir, '/') = 0;
 	
-	if (out)
+	// find the last directory the paths have in common.
+	size_t common = 0;
+	for (size_t i = 0;; ++i)
 	{
-		*out = (struct node)
-		{
-			.type = NT_PARAGRAPH,
-		};
-		out->data[0] = htmlified_substr(data, begin, *i, HS_NONE);
+		if ((!from_dir[i] || from_dir[i] == '/') && to_abs[i] == '/')
+			common = i;
+		if (!from_dir[i] || from_dir[i] != to_abs[i])
+			break;
 	}
 	
-	return PS_OK;
+	size_t nups = 0;
+	for (char const *p = &from_dir[common]; *p; ++p)
+		nups += *p == '/';
+	
+	char *rel = malloc(3 * nups + strlen(to_abs) + 1);
+	char *p = rel;
+	for (size_t i = 0; i < nups; ++i)
+		p += sprintf(p, "../");
+	strcpy(p, &to_abs[common + 1]);
+	
+	free(from_dir);
+	free(to_abs);
+	
+	return rel;
 }
 
-static enum parse_status
-parse_table(struct node *out,
-            size_t *i,
-            char const *data,
-            size_t len,
-            char const *file)
+// replace the `.cmf` extension of a path, if any, with `ext`.
+static char *
+path_with_ext(char const *path, char const *ext)
 {
-	// validate beginning of table.
-	{
-		while (data[*i] && data[*i] == '-')
-			++*i;
-		if (data[*i] != '\n')
-		{
-			prog_err(file, data, *i, "expected valid table after ---!");
-			return PS_ERR;
-		}
-	}
+	size_t path_len = strlen(path), ext_len = strlen(ext);
+	if (str_has_suffix(path, ".cmf"))
+		path_len -= 4;
+	else if (str_has_suffix(path, ".cmfb"))
+		path_len -= 5;
 	
-	if (out)
-	{
-		*out = (struct node)
-		{
-			.type = NT_TABLE,
-		};
-	}
+	char *new_path = malloc(path_len + ext_len + 1);
+	memcpy(new_path, path, path_len);
+	memcpy(&new_path[path_len], ext, ext_len + 1);
 	
-	for (++*i; data[*i] && data[*i] != '\n';)
-	{
-		if (data[*i] == '|')
-		{
-			struct node row;
-			if (parse_table_row(&row, i, data, len, file))
-				return PS_ERR;
-			if (out)
-				node_add_child(out, &row);
-		}
-		else
-		{
-			prog_err(file, data, *i, "expected either | or table end!");
-			return PS_ERR;
-		}
-	}
+	return new_path;
+}
 
-	return PS_OK;
+static double
+secs_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
 }
 
-static enum parse_status
-parse_table_row(struct node *out,
-                size_t *i,
-                char const *data,
-                size_t len,
-                char const *file)
+// read the server's configuration. each non-empty line not beginning with `#`
+// is a directive followed by its arguments. `style name file` and `docdata name
+// file` register a file which requests may name, loading it; `max-markup bytes`
+// and `idle-timeout secs` set the limits on connections.
+static int
+serve_conf_read(struct serve *srv, char const *file)
 {
-	if (out)
+	FILE *fp = fopen(file, "rb");
+	if (!fp)
 	{
-		*out = (struct node)
-		{
-			.type = NT_TABLE_ROW,
-		};
+		fprintf(stderr, "err: failed to open serve config file for reading: %s!\n", file);
+		return 1;
 	}
 	
-	++*i;
-	size_t col = 0;
-	for (;;)
+	int rc = 0;
+	char *line = NULL;
+	size_t line_cap = 0;
+	ssize_t line_len;
+	for (size_t line_num = 1; !rc && (line_len = getline(&line, &line_cap, fp)) != -1; ++line_num)
 	{
-		size_t begin = *i;
-		while (data[*i] && data[*i] != '|')
-		{
-			if (*i + 1 < len && data[*i] == '\\')
-				++*i;
-			++*i;
-		}
-		if (!data[*i])
-		{
-			prog_err(file, data, *i, "incomplete table row data!");
-			return PS_ERR;
-		}
+		while (line_len > 0 && strchr("\r\n", line[line_len - 1]))
+			line[--line_len] = 0;
 		
-		if (out)
-		{
-			char *sub = htmlified_substr(data, begin, *i, HS_NONE);
-			if (col >= out->nchildren)
-			{
-				struct node item =
-				{
-					.type = NT_TABLE_ITEM,
-				};
-				item.data[0] = sub;
-				
-				if (out)
-					node_add_child(out, &item);
-			}
-			else
-			{
-				size_t slen = strlen(out->children[col].data[0]);
-				size_t scap = slen + 1;
-				str_dyn_append_c(&out->children[col].data[0], &slen, &scap, ' ');
-				str_dyn_append_s(&out->children[col].data[0], &slen, &scap, sub);
-				free(sub);
-			}
+		// split off the directive and the first argument. the rest of the line
+		// is the last argument, so that paths may hold spaces.
+		char *args[3] = {line};
+		for (int i = 0; i < 2; ++i)
+		{
+			args[i] += strspn(args[i], " \t");
+			args[i + 1] = args[i] + strcspn(args[i], " \t");
+			if (*args[i + 1])
+				*args[i + 1]++ = 0;
 		}
+		args[2] += strspn(args[2], " \t");
 		
-		++*i;
-		if (data[*i] == '\n')
-		{
-			++*i;
-			col = 0;
-			if (!data[*i])
-			{
-				prog_err(file, data, *i, "unterminated table row!");
-				return PS_ERR;
-			}
-			else if (data[*i] == '-')
+		if (!*args[0] || *args[0] == '#')
+			continue;
+		
+		bool max_markup = !strcmp(args[0], "max-markup");
+		if (max_markup || !strcmp(args[0], "idle-timeout"))
+		{
+			char *end;
+			errno = 0;
+			unsigned long long n = strtoull(args[1], &end, 10);
+			if (!isdigit((unsigned char)*args[1]) || *end || *args[2] || errno
+				|| n > (max_markup ? SERVE_MAX_MARKUP : UINT_MAX))
 			{
-				while (data[*i] && data[*i] == '-')
-					++*i;
-				
-				if (data[*i] && data[*i] != '\n')
-				{
-					prog_err(file, data, *i, "table row improperly terminated!");
-					return PS_ERR;
-				}
-				
-				++*i;
+				fprintf(stderr, "err: invalid limit in serve config: %s:%zu!\n", file, line_num);
+				rc = 1;
 				break;
 			}
-			else if (data[*i] == '|')
-				++*i;
+			
+			if (max_markup)
+				srv->max_markup = n;
 			else
-			{
-				prog_err(file, data, *i, "expected row to either terminate or continue!");
-				return PS_ERR;
-			}
+				srv->idle_secs = n;
+			continue;
 		}
-		else
-			++col;
-	}
-	
-	return PS_OK;
-}
-
-static enum parse_status
-parse_title(struct node *out, size_t *i, char const *data, char const *file)
-{
-	// get and validate header size.
-	int hsize = 0;
-	{
-		size_t title_begin = *i;
-		while (data[*i] == '=')
+		
+		bool docdata = !strcmp(args[0], "docdata");
+		if ((!docdata && strcmp(args[0], "style")) || !*args[1] || !*args[2])
 		{
-			++*i;
-			++hsize;
+			fprintf(stderr, "err: invalid directive in serve config: %s:%zu!\n", file, line_num);
+			rc = 1;
+			break;
 		}
 		
-		if (hsize > 6)
+		if (strlen(args[1]) > SERVE_MAX_NAME || serve_file_get(srv, args[1], docdata))
 		{
-			prog_err(file, data, title_begin, "minimum title size is 6!");
-			return PS_ERR;
+			fprintf(stderr, "err: invalid or repeated name in serve config: %s:%zu!\n", file, line_num);
+			rc = 1;
+			break;
 		}
-	}
-	
-	size_t begin = *i;
-	while (data[*i] && strncmp("\n\n", &data[*i], 2))
-		++*i;
-	
-	if (out)
-	{
-		*out = (struct node)
+		
+		srv->files = reallocarray(srv->files, srv->nfiles + 1, sizeof(struct serve_file));
+		struct serve_file *sf = &srv->files[srv->nfiles];
+		*sf = (struct serve_file)
 		{
-			.type = NT_TITLE,
-			.arg = hsize,
+			.name = strdup(args[1]),
+			.docdata = docdata,
 		};
-		out->data[0] = htmlified_substr(data, begin, *i, HS_NONE);
+		
+		rc = serve_file_load(sf, args[2]);
+		if (rc)
+			free(sf->name);
+		else
+			++srv->nfiles;
 	}
 	
-	return PS_OK;
+	free(line);
+	fclose(fp);
+	
+	return rc;
 }
 
-static enum parse_status
-parse_u_list(struct node *out, size_t *i, char const *data, size_t len)
+// handle requests on a connection until the client closes it.
+static void
+serve_conn(struct serve *srv, int fd)
 {
-	if (out)
-	{
-		*out = (struct node)
-		{
-			.type = NT_U_LIST,
-		};
-	}
+	char *paths = NULL, *markup = NULL;
+	size_t markup_cap = 0;
 	
 	for (;;)
 	{
-		int depth = 0;
-		while (data[*i] == '*')
+		struct serve_req req;
+		if (serve_recv(fd, &req, sizeof(req)))
+			break;
+		
+		// the payload of a request beyond the limits is not read, so the
+		// connection is closed once the client is told why.
+		if (req.style_len > SERVE_MAX_NAME || req.docdata_len > SERVE_MAX_NAME)
 		{
-			++*i;
-			++depth;
+			static char const msg[] = "err: style or docdata name too long!\n";
+			serve_send_err(fd, msg, sizeof(msg) - 1);
+			break;
 		}
 		
-		size_t begin = *i;
-		while (data[*i]
-		       && strncmp("\n\n", &data[*i], 2)
-		       && strncmp("\n*", &data[*i], 2))
+		if (req.markup_len > srv->max_markup)
 		{
-			++*i;
+			static char const msg[] = "err: markup exceeds max-markup!\n";
+			serve_send_err(fd, msg, sizeof(msg) - 1);
+			break;
 		}
 		
-		if (out)
+		paths = realloc(paths, req.style_len + req.docdata_len + 2);
+		if (req.markup_len + 1 > markup_cap)
 		{
-			struct node item =
-			{
-				.type = NT_LIST_ITEM,
-				.arg = depth,
-			};
-			item.data[0] = htmlified_substr(data, begin, *i, HS_NONE);
-			node_add_child(out, &item);
+			markup_cap = req.markup_len + 1;
+			markup = realloc(markup, markup_cap);
 		}
 		
-		++*i;
-		if (*i >= len || data[*i] == '\n')
+		char *style_name = paths, *docdata_name = &paths[req.style_len + 1];
+		if (serve_recv(fd, style_name, req.style_len)
+			|| serve_recv(fd, docdata_name, req.docdata_len)
+			|| serve_recv(fd, markup, req.markup_len))
+		{
 			break;
-	}
-	
-	return PS_OK;
-}
-
-static void
-prog_err(char const *file, char const *data, size_t start, char const *msg)
-{
-	fprintf(stderr,
-	        "%s[%zu] err: %s\n"
-	        "%zu...    %s\n",
-	        file,
-	        start,
-	        msg,
-	        start,
-	        single_line(data, start));
-}
+		}
+		style_name[req.style_len] = 0;
+		docdata_name[req.docdata_len] = 0;
+		markup[req.markup_len] = 0;
+		
+		char *err_buf = NULL;
+		size_t err_len = 0;
+		FILE *err_fp = open_memstream(&err_buf, &err_len);
+		
+		struct cmfc_opts opts =
+		{
+			.file = "request",
+			.style = conf.style_file ? file_data.style.data : NULL,
+			.style_len = file_data.style.len,
+			.docdata = file_data.base,
+			.renumber_footnotes = conf.renumber,
+			.heading_ids = conf.heading_ids,
+			.toc = conf.toc,
+			.minify = conf.minify,
+			.max_out = conf.max_out,
+		};
+		
+		int rc = CMFC_OK;
+		if (req.style_len)
+		{
+			struct serve_file const *sf = serve_file_get(srv, style_name, false);
+			if (sf)
+			{
+				opts.style = sf->buf.data;
+				opts.style_len = sf->buf.len;
+			}
+			else
+			{
+				fprintf(err_fp, "err: unknown style: %s!\n", style_name);
+				rc = CMFC_ERR;
+			}
+		}
+		
+		if (req.docdata_len)
+		{
+			struct serve_file const *sf = serve_file_get(srv, docdata_name, true);
+			if (sf)
+				opts.docdata = sf->base;
+			else
+			{
+				fprintf(err_fp, "err: unknown docdata: %s!\n", docdata_name);
+				rc = CMFC_ERR;
+			}
+		}
+		
+		// the output is sent as soon as it is ready.
+		if (rc == CMFC_OK)
+		{
+			struct cmfc_error err;
+			rc = cmfc_compile(&opts, markup, req.markup_len, serve_write, &fd, &err);
+			if (rc == CMFC_ERR)
+				err_print(err_fp, &err);
+		}
+		
+		fclose(err_fp);
+		
+		int send_rc = rc == CMFC_ERR_IO;
+		if (rc == CMFC_ERR)
+			send_rc = serve_send_err(fd, err_buf, err_len);
+		
+		free(err_buf);
+		
+		if (send_rc)
+			break;
+	}
+	
+	free(markup);
+	free(paths);
+}
 
-// temporarily access a single line of a larger string as a null-terminated
-// string; only suitable for temporary uses, e.g. error messages.
-static char const *
-single_line(char const *s, size_t start)
+// find a registered stylesheet or docdata file by name.
+static struct serve_file const *
+serve_file_get(struct serve const *srv, char const *name, bool docdata)
 {
-	static char buf[1024];
+	for (size_t i = 0; i < srv->nfiles; ++i)
+	{
+		struct serve_file const *sf = &srv->files[i];
+		if (sf->docdata == docdata && !strcmp(sf->name, name))
+			return sf;
+	}
 	
-	size_t i;
-	for (i = 0; i < sizeof(buf) - 1; ++i)
+	return NULL;
+}
+
+static int
+serve_file_load(struct serve_file *sf, char const *path)
+{
+	char const *kind = sf->docdata ? "docdata" : "style";
+	int fd = open(path, O_RDONLY);
+	if (fd == -1)
 	{
-		if (!s[start + i])
-			break;
+		fprintf(stderr, "err: failed to open %s file for reading: %s!\n", kind, path);
+		return 1;
+	}
+	
+	int rc = file_read(&sf->buf, fd, path, kind);
+	close(fd);
+	if (rc)
+		return 1;
+	
+	if (!sf->docdata && conf.minify)
+		style_minify(&sf->buf);
+	
+	if (sf->docdata)
+	{
+		struct cmfc_error err;
+		sf->base = cmfc_docdata_new(sf->buf.data, sf->buf.len, path, &err);
+		if (!sf->base)
+		{
+			err_print(stderr, &err);
+			file_release(&sf->buf);
+			return 1;
+		}
+	}
+	
+	return 0;
+}
+
+static int
+serve_recv(int fd, void *buf, size_t n)
+{
+	for (size_t got = 0; got < n;)
+	{
+		ssize_t nread = recv(fd, (char *)buf + got, n - got, 0);
+		if (nread == -1 && errno == EINTR)
+			continue;
 		
-		if (s[start + i] == '\n')
-			break;
+		if (nread <= 0)
+			return 1;
 		
-		buf[i] = s[start + i];
+		got += nread;
 	}
-	buf[i] = 0;
 	
-	return buf;
+	return 0;
 }
 
 static void
-str_dyn_append_s(char **str, size_t *len, size_t *cap, char const *s)
+serve_release(struct serve *srv)
+{
+	for (size_t i = 0; i < srv->nfiles; ++i)
+	{
+		free(srv->files[i].name);
+		file_release(&srv->files[i].buf);
+		cmfc_docdata_free(srv->files[i].base);
+	}
+	free(srv->files);
+}
+
+// serve compile requests until killed. each worker thread accepts and handles
+// connections on its own; state shared between requests is read-only.
+static int
+serve_run(void)
+{
+	struct serve srv =
+	{
+		.max_markup = SERVE_DEFAULT_MAX_MARKUP,
+		.idle_secs = SERVE_DEFAULT_IDLE_SECS,
+	};
+	if (conf.serve_conf && serve_conf_read(&srv, conf.serve_conf))
+	{
+		serve_release(&srv);
+		return 1;
+	}
+	
+	srv.fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (srv.fd == -1)
+	{
+		fprintf(stderr, "err: failed to create socket!\n");
+		serve_release(&srv);
+		return 1;
+	}
+	
+	struct sockaddr_un addr =
+	{
+		.sun_family = AF_UNIX,
+	};
+	if (strlen(conf.listen_path) >= sizeof(addr.sun_path))
+	{
+		fprintf(stderr, "err: socket path too long: %s!\n", conf.listen_path);
+		close(srv.fd);
+		serve_release(&srv);
+		return 1;
+	}
+	strcpy(addr.sun_path, conf.listen_path);
+	
+	// replace a stale socket left behind by a previous server.
+	struct stat st;
+	if (!stat(conf.listen_path, &st) && S_ISSOCK(st.st_mode))
+		unlink(conf.listen_path);
+	
+	if (bind(srv.fd, (struct sockaddr *)&addr, sizeof(addr)) || listen(srv.fd, SOMAXCONN))
+	{
+		fprintf(stderr, "err: failed to listen on socket: %s!\n", conf.listen_path);
+		close(srv.fd);
+		serve_release(&srv);
+		return 1;
+	}
+	
+	// clients going away must not take the server with them.
+	signal(SIGPIPE, SIG_IGN);
+	
+	pthread_t *threads = calloc(conf.njobs, sizeof(pthread_t));
+	for (int i = 0; i < conf.njobs; ++i)
+		pthread_create(&threads[i], NULL, serve_worker, &srv);
+	
+	for (int i = 0; i < conf.njobs; ++i)
+		pthread_join(threads[i], NULL);
+	
+	free(threads);
+	close(srv.fd);
+	serve_release(&srv);
+	
+	return 1;
+}
+
+static int
+serve_send(int fd, void const *buf, size_t n)
+{
+	for (size_t sent = 0; sent < n;)
+	{
+		ssize_t nsent = send(fd, (char const *)buf + sent, n - sent, 0);
+		if (nsent == -1 && errno == EINTR)
+			continue;
+		
+		if (nsent == -1)
+			return 1;
+		
+		sent += nsent;
+	}
+	
+	return 0;
+}
+
+// reply with the diagnostics of a failed request.
+static int
+serve_send_err(int fd, char const *msg, size_t len)
 {
-	size_t slen = strlen(s);
+	struct serve_rep rep =
+	{
+		.status = CMFC_ERR,
+		.len = len,
+	};
+	return serve_send(fd, &rep, sizeof(rep)) || serve_send(fd, msg, len);
+}
+
+static void *
+serve_worker(void *arg)
+{
+	struct serve *srv = arg;
 	
-	// grow dynamic string as necessary.
+	for (;;)
 	{
-		while (*len + slen + 1 >= *cap)
+		int fd = accept(srv->fd, NULL, NULL);
+		if (fd == -1 && (errno == EINTR || errno == ECONNABORTED))
+			continue;
+		
+		if (fd == -1)
 		{
-			*cap *= 2;
-			*str = realloc(*str, *cap);
+			fprintf(stderr, "err: failed to accept connection: %s!\n", conf.listen_path);
+			return NULL;
 		}
+		
+		// a client idle for too long gives up its worker to others.
+		struct timeval tv = {.tv_sec = srv->idle_secs};
+		setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+		setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+		
+		serve_conn(srv, fd);
+		close(fd);
+	}
+}
+
+// reply with the output of a compile, which is passed on in one go.
+static int
+serve_write(void *user, char const *data, size_t len)
+{
+	int fd = *(int const *)user;
+	
+	struct serve_rep rep =
+	{
+		.len = len,
+	};
+	return serve_send(fd, &rep, sizeof(rep)) || serve_send(fd, data, len);
+}
+
+// order inputs from the slowest compile to the fastest.
+static int
+stats_cmp(void const *a, void const *b)
+{
+	double a_secs = (*(struct input const **)a)->stats.secs;
+	double b_secs = (*(struct input const **)b)->stats.secs;
+	return (a_secs < b_secs) - (a_secs > b_secs);
+}
+
+// print the members of a JSON object describing a document's statistics.
+static void
+stats_print(FILE *fp, struct doc_stats const *ds)
+{
+	fprintf(fp,
+	        "\"secs\": %.6f, \"parse_secs\": %.6f, \"verify_secs\": %.6f, \"gen_secs\": %.6f, "
+	        "\"bytes_in\": %llu, \"bytes_out\": %llu, \"allocs\": %llu, \"peak_mem_bytes\": %llu, ",
+	        ds->secs,
+	        ds->lib.parse_secs,
+	        ds->lib.verify_secs,
+	        ds->lib.gen_secs,
+	        (unsigned long long)ds->lib.bytes_in,
+	        (unsigned long long)ds->lib.bytes_out,
+	        (unsigned long long)ds->lib.allocs,
+	        (unsigned long long)ds->lib.peak_mem);
+	
+	fprintf(fp, "\"nodes\": {");
+	for (int i = 0; i < CMFC_NODE_TYPES; ++i)
+		fprintf(fp, "%s\"%s\": %llu", i ? ", " : "", cmfc_node_type_name(i), (unsigned long long)ds->lib.nodes[i]);
+	fprintf(fp, "}");
+}
+
+// report the statistics of the last compile of the given inputs, as indices
+// into `conf.inputs` or NULL for all, as a JSON object on stderr. it is
+// written in one go, after any diagnostics.
+static void
+stats_report(size_t const *inputs, size_t ninputs, double secs)
+{
+	char *buf;
+	size_t len;
+	FILE *fp = open_memstream(&buf, &len);
+	
+	struct rusage ru;
+	getrusage(RUSAGE_SELF, &ru);
+	
+	fprintf(fp, "{\n");
+	fprintf(fp, "\t\"secs\": %.6f,\n", secs);
+	fprintf(fp, "\t\"file_data_read_secs\": %.6f,\n", file_data.read_secs);
+	fprintf(fp, "\t\"docdata_parse_secs\": %.6f,\n", file_data.parse_secs);
+	fprintf(fp, "\t\"peak_rss_bytes\": %lld,\n", (long long)ru.ru_maxrss * 1024);
+	
+	// documents are compiled concurrently, so the peak memory of the whole
+	// build is taken to be that of the hungriest document.
+	struct input const **docs = malloc(ninputs * sizeof(struct input const *));
+	struct doc_stats total = {0};
+	size_t ncompiled = 0, nfailed = 0;
+	for (size_t i = 0; i < ninputs; ++i)
+	{
+		docs[i] = &conf.inputs[inputs ? inputs[i] : i];
+		struct doc_stats const *ds = &docs[i]->stats;
+		
+		ncompiled += ds->compiled;
+		nfailed += ds->rc != 0;
+		
+		total.secs += ds->secs;
+		total.lib.parse_secs += ds->lib.parse_secs;
+		total.lib.verify_secs += ds->lib.verify_secs;
+		total.lib.gen_secs += ds->lib.gen_secs;
+		for (int j = 0; j < CMFC_NODE_TYPES; ++j)
+			total.lib.nodes[j] += ds->lib.nodes[j];
+		total.lib.bytes_in += ds->lib.bytes_in;
+		total.lib.bytes_out += ds->lib.bytes_out;
+		total.lib.allocs += ds->lib.allocs;
+		if (ds->lib.peak_mem > total.lib.peak_mem)
+			total.lib.peak_mem = ds->lib.peak_mem;
+	}
+	
+	fprintf(fp, "\t\"total\": {\"documents\": %zu, \"compiled\": %zu, \"failed\": %zu, ", ninputs, ncompiled, nfailed);
+	stats_print(fp, &total);
+	fprintf(fp, "},\n");
+	
+	fprintf(fp, "\t\"documents\": [");
+	for (size_t i = 0; i < ninputs; ++i)
+	{
+		struct doc_stats const *ds = &docs[i]->stats;
+		
+		fprintf(fp, "%s\n\t\t{\"file\": ", i ? "," : "");
+		str_print_json(fp, docs[i]->markup_file, strlen(docs[i]->markup_file));
+		fprintf(fp, ", \"status\": \"%s\", ", ds->rc ? "failed" : ds->compiled ? "ok" : "up_to_date");
+		stats_print(fp, ds);
+		fprintf(fp, "}");
 	}
+	fprintf(fp, "\n\t],\n");
 	
-	// write new data.
+	qsort(docs, ninputs, sizeof(struct input const *), stats_cmp);
+	fprintf(fp, "\t\"slowest\": [");
+	for (size_t i = 0; i < ninputs && i < STATS_TOP; ++i)
 	{
-		strcpy(&(*str)[*len], s);
-		*len += slen;
+		fprintf(fp, "%s\n\t\t{\"file\": ", i ? "," : "");
+		str_print_json(fp, docs[i]->markup_file, strlen(docs[i]->markup_file));
+		fprintf(fp, ", \"secs\": %.6f}", docs[i]->stats.secs);
 	}
+	fprintf(fp, "\n\t]\n");
+	fprintf(fp, "}\n");
+	
+	fclose(fp);
+	fwrite(buf, 1, len, stderr);
+	fflush(stderr);
+	
+	free(buf);
+	free(docs);
 }
 
+static bool
+str_has_suffix(char const *s, char const *suffix)
+{
+	size_t slen = strlen(s), suffix_len = strlen(suffix);
+	return slen >= suffix_len && !strcmp(&s[slen - suffix_len], suffix);
+}
+
+// print a string as a JSON string. bytes which are not part of valid UTF-8
+// are replaced, as JSON must be valid Unicode.
 static void
-str_dyn_append_c(char **str, size_t *len, size_t *cap, char c)
+str_print_json(FILE *fp, char const *s, size_t len)
 {
-	// grow dynamic string as necessary.
+	fputc('"', fp);
+	for (size_t i = 0; i < len;)
 	{
-		if (*len + 1 >= *cap)
+		unsigned char c = s[i];
+		size_t n = utf8_len(&s[i], len - i);
+		if (!n)
 		{
-			*cap *= 2;
-			*str = realloc(*str, *cap);
+			fputs("\\ufffd", fp);
+			++i;
 		}
+		else if (c == '"' || c == '\\')
+		{
+			fprintf(fp, "\\%c", c);
+			++i;
+		}
+		else if (c < 0x20)
+		{
+			fprintf(fp, "\\u%04x", c);
+			++i;
+		}
+		else
+		{
+			fwrite(&s[i], 1, n, fp);
+			i += n;
+		}
+	}
+	fputc('"', fp);
+}
+
+// replace a stylesheet by its minified form, which is then what every document
+// embeds or links to.
+static void
+style_minify(struct file_buf *style)
+{
+	char *data = malloc(style->len + 1);
+	size_t len = cmfc_style_minify(style->data, style->len, data);
+	data[len] = 0;
+	
+	file_release(style);
+	*style = (struct file_buf)
+	{
+		.data = data,
+		.len = len,
+	};
+}
+
+// write the stylesheet into its directory under a name derived from its
+// contents, so that it may be cached for as long as pages link to it. a file
+// of that name is taken to have been written by a previous build.
+static int
+style_write(void)
+{
+	char name[32];
+	uint64_t h = cmfc_hash(CMFC_HASH_INIT, file_data.style.data, file_data.style.len);
+	snprintf(name, sizeof(name), "style-%016llx.css", (unsigned long long)h);
+	
+	free(file_data.style_path);
+	file_data.style_path = path_join(conf.style_dir, name);
+	
+	free(file_data.style_critical);
+	file_data.style_critical = NULL;
+	file_data.style_critical_len = 0;
+	if (conf.style_critical)
+	{
+		file_data.style_critical = malloc(file_data.style.len + 1);
+		file_data.style_critical_len = cmfc_style_critical(file_data.style.data,
+		                                                   file_data.style.len,
+		                                                   file_data.style_critical);
+	}
+	
+	if (!access(file_data.style_path, F_OK))
+		return 0;
+	
+	if (mkdir_parents(file_data.style_path))
+		return 1;
+	
+	char *tmp_path = malloc(strlen(file_data.style_path) + 5);
+	sprintf(tmp_path, "%s.tmp", file_data.style_path);
+	
+	FILE *fp = fopen(tmp_path, "wb");
+	if (!fp)
+	{
+		fprintf(stderr, "err: failed to open stylesheet for writing: %s!\n", tmp_path);
+		free(tmp_path);
+		return 1;
+	}
+	
+	fwrite(file_data.style.data, 1, file_data.style.len, fp);
+	
+	int err = ferror(fp);
+	if (fclose(fp) || err || rename(tmp_path, file_data.style_path))
+	{
+		fprintf(stderr, "err: failed to write stylesheet: %s!\n", file_data.style_path);
+		remove(tmp_path);
+		free(tmp_path);
+		return 1;
+	}
+	
+	free(tmp_path);
+	return 0;
+}
+
+static int
+term_cmp(void const *a, void const *b)
+{
+	struct term const *t_a = a, *t_b = b;
+	return word_cmp(t_a->word, t_a->len, t_b->word, t_b->len);
+}
+
+static void
+term_table_release(struct term_table *tt)
+{
+	for (size_t t = 0; t < tt->nterms; ++t)
+		free(tt->terms[t].word);
+	free(tt->terms);
+	free(tt->slots);
+	
+	*tt = (struct term_table){0};
+}
+
+// write out the words of a document, sorted, as they are kept for the search
+// index, and release them.
+static void
+terms_dump(struct term_table *tt, struct file_buf *out)
+{
+	qsort(tt->terms, tt->nterms, sizeof(struct term), term_cmp);
+	
+	size_t len = 0;
+	FILE *fp = open_memstream(&out->data, &len);
+	for (size_t t = 0; t < tt->nterms; ++t)
+		fprintf(fp, "%s %lu\n", tt->terms[t].word, tt->terms[t].count);
+	fclose(fp);
+	
+	out->len = len;
+	term_table_release(tt);
+}
+
+// load the words of a document from the build cache, provided that they were
+// cached along with its output. they are checked to be well formed and sorted,
+// as the search index is merged from them.
+static bool
+terms_load(struct input *in, uint64_t key)
+{
+	char *entry_path = cache_entry_path(in->out_file);
+	char *path = path_with_ext(entry_path, ".terms");
+	free(entry_path);
+	
+	struct file_buf file;
+	int fd = open(path, O_RDONLY);
+	int read_rc = fd == -1 || file_read(&file, fd, path, "cached words");
+	if (fd != -1)
+		close(fd);
+	free(path);
+	if (read_rc)
+		return false;
+	
+	char magic[32];
+	unsigned long long file_key;
+	int hdr_len = 0;
+	bool ok = sscanf(file.data, "%31s %llx\n%n", magic, &file_key, &hdr_len) == 2
+	          && hdr_len
+	          && !strcmp(magic, TERMS_MAGIC)
+	          && file_key == key;
+	
+	char const *prev = NULL;
+	size_t prev_len = 0;
+	for (char const *p = &file.data[hdr_len]; ok && p < &file.data[file.len];)
+	{
+		// words must not break the lines they are on, nor the JSON strings
+		// they are written into.
+		size_t len = 0;
+		while ((unsigned char)p[len] > ' ' && p[len] != '"' && p[len] != '\\')
+			++len;
+		size_t ndigits = p[len] == ' ' ? strspn(&p[len + 1], "0123456789") : 0;
+		ok = len
+		     && ndigits
+		     && p[len + 1 + ndigits] == '\n'
+		     && (!prev || word_cmp(prev, prev_len, p, len) < 0);
+		
+		prev = p;
+		prev_len = len;
+		p += len + ndigits + 2;
+	}
+	
+	if (ok)
+	{
+		in->terms.len = file.len - hdr_len;
+		in->terms.data = malloc(in->terms.len + 1);
+		memcpy(in->terms.data, &file.data[hdr_len], in->terms.len + 1);
+	}
+	
+	file_release(&file);
+	
+	return ok;
+}
+
+static int
+terms_store(char const *out_file, uint64_t key, struct file_buf const *terms)
+{
+	char *entry_path = cache_entry_path(out_file);
+	char *path = path_with_ext(entry_path, ".terms");
+	char *tmp_path = path_with_ext(path, ".tmp");
+	free(entry_path);
+	
+	int rc = 1;
+	
+	if (mkdir_parents(path))
+		goto done;
+	
+	FILE *fp = fopen(tmp_path, "wb");
+	if (!fp)
+	{
+		fprintf(stderr, "err: failed to open cached words for writing: %s!\n", tmp_path);
+		goto done;
 	}
 	
-	// write new data.
+	fprintf(fp, "%s %016llx\n", TERMS_MAGIC, (unsigned long long)key);
+	fwrite(terms->data, 1, terms->len, fp);
+	
+	int err = ferror(fp);
+	if (fclose(fp) || err || rename(tmp_path, path))
 	{
-		(*str)[*len] = c;
-		(*str)[*len + 1] = 0;
-		++*len;
+		fprintf(stderr, "err: failed to write cached words: %s!\n", path);
+		remove(tmp_path);
+		goto done;
 	}
+	
+	rc = 0;
+	
+done:
+	free(tmp_path);
+	free(path);
+	
+	return rc;
 }
 
 static void
@@ -1497,9 +2704,300 @@ usage(char const *name)
 	       "\t%s [options] file\n"
 	       "options:\n"
 	       "\t-A       dump the AST of the parsed markup\n"
+	       "\t-B       write the binary AST of the markup, to be compiled in its place\n"
+	       "\t-C dir   skip documents whose output is up to date per the cache in dir\n"
+	       "\t-c       embed the critical subset of the linked stylesheet\n"
 	       "\t-d       use the specified file as docdata\n"
+	       "\t-H       give titles ids derived from their text\n"
 	       "\t-h       display this text\n"
+	       "\t-I file  write a search index of the words of the documents to file\n"
+	       "\t-j n     compile using at most n threads\n"
+	       "\t-L dir   write the stylesheet once into dir and link to it\n"
+	       "\t-l sock  serve compile requests on the specified Unix socket\n"
+	       "\t-M n     fail documents whose output would exceed n bytes\n"
+	       "\t-m file  also compile the files listed in the specified manifest\n"
+	       "\t-n       number footnotes in order of their first mention\n"
+	       "\t-O dir   write outputs to the specified directory\n"
 	       "\t-o file  write output to the specified file\n"
-	       "\t-s file  use the specified file as a stylesheet\n",
+	       "\t-r file  serve the stylesheets and docdata registered in file\n"
+	       "\t-S       stream documents, compiling them block by block\n"
+	       "\t-s file  use the specified file as a stylesheet\n"
+	       "\t-T       report statistics of the build as JSON on stderr (--stats)\n"
+	       "\t-t       begin documents with a table of contents, implying -H\n"
+	       "\t-w       keep running, recompiling whenever an input changes\n"
+	       "\t-x       minify the output and stylesheet (--minify)\n"
+	       "\t-Z       write output gzip-compressed instead\n"
+	       "\t-z       also write a gzip-compressed copy of each output, appending .gz\n",
 	       name);
 }
+
+// the length of the UTF-8 sequence beginning a string, or 0 if it is not valid,
+// being truncated, overlong, a surrogate or beyond U+10FFFF.
+static size_t
+utf8_len(char const *s, size_t len)
+{
+	unsigned char const *u = (unsigned char const *)s;
+	if (u[0] < 0x80)
+		return 1;
+	
+	size_t n = u[0] >= 0xf0 ? 4 : u[0] >= 0xe0 ? 3 : u[0] >= 0xc0 ? 2 : 0;
+	if (!n || n > len || u[0] > 0xf4)
+		return 0;
+	
+	uint32_t cp = u[0] & (0x7f >> n);
+	for (size_t i = 1; i < n; ++i)
+	{
+		if ((u[i] & 0xc0) != 0x80)
+			return 0;
+		cp = cp << 6 | (u[i] & 0x3f);
+	}
+	
+	static uint32_t const min_cp[] = {0, 0, 0x80, 0x800, 0x10000};
+	if (cp < min_cp[n] || (cp >= 0xd800 && cp <= 0xdfff) || cp > 0x10ffff)
+		return 0;
+	
+	return n;
+}
+
+static int
+watch_add(struct watch *w, char const *path, enum watch_kind kind, size_t input)
+{
+	if (!strcmp(path, "-"))
+	{
+		fprintf(stderr, "err: cannot watch standard input!\n");
+		return 1;
+	}
+	
+	char *slash = strrchr(path, '/');
+	char *dir = slash ? strndup(path, slash == path ? 1 : slash - path) : strdup(".");
+	
+	int wd = inotify_add_watch(w->fd, dir, IN_CLOSE_WRITE | IN_MOVED_TO);
+	if (wd == -1)
+	{
+		fprintf(stderr, "err: failed to watch directory: %s!\n", dir);
+		free(dir);
+		return 1;
+	}
+	free(dir);
+	
+	w->files = reallocarray(w->files, w->nfiles + 1, sizeof(struct watch_file));
+	w->files[w->nfiles++] = (struct watch_file)
+	{
+		.wd = wd,
+		.name = strdup(slash ? slash + 1 : path),
+		.kind = kind,
+		.input = input,
+	};
+	
+	return 0;
+}
+
+static void
+watch_release(struct watch *w)
+{
+	for (size_t i = 0; i < w->nfiles; ++i)
+		free(w->files[i].name);
+	free(w->files);
+	
+	if (w->fd != -1)
+		close(w->fd);
+}
+
+// recompile inputs as they change, reusing the loaded style and docdata unless
+// they change themselves. only returns on failure.
+static int
+watch_run(void)
+{
+	int rc = 1;
+	
+	struct watch w =
+	{
+		.fd = inotify_init1(IN_CLOEXEC),
+	};
+	if (w.fd == -1)
+	{
+		fprintf(stderr, "err: failed to initialize inotify!\n");
+		return 1;
+	}
+	
+	bool *dirty = calloc(conf.ninputs, sizeof(bool));
+	size_t *inputs = malloc(conf.ninputs * sizeof(size_t));
+	int *rcs = malloc(conf.ninputs * sizeof(int));
+	
+	// add watches.
+	{
+		if (conf.style_file && watch_add(&w, conf.style_file, WK_STYLE, 0))
+			goto done;
+		
+		if (conf.docdata_file && watch_add(&w, conf.docdata_file, WK_DOCDATA, 0))
+			goto done;
+		
+		for (size_t i = 0; i < conf.ninputs; ++i)
+		{
+			if (watch_add(&w, conf.inputs[i].markup_file, WK_MARKUP, i))
+				goto done;
+		}
+	}
+	
+	// whether the style and docdata were last loaded successfully.
+	bool prepared = true;
+	
+	for (;;)
+	{
+		bool style_changed = false, docdata_changed = false, all_dirty = false;
+		
+		// wait for a change, then until changes have settled.
+		int timeout = -1;
+		for (;;)
+		{
+			struct pollfd pfd =
+			{
+				.fd = w.fd,
+				.events = POLLIN,
+			};
+			
+			int npoll = poll(&pfd, 1, timeout);
+			if (npoll == -1 && errno == EINTR)
+				continue;
+			
+			if (npoll == -1)
+			{
+				fprintf(stderr, "err: failed to wait for changes!\n");
+				goto done;
+			}
+			
+			if (npoll == 0)
+				break;
+			
+			union
+			{
+				struct inotify_event ev;
+				char buf[4096];
+			} evs;
+			
+			ssize_t len = read(w.fd, evs.buf, sizeof(evs.buf));
+			if (len == -1 && errno == EINTR)
+				continue;
+			
+			if (len == -1)
+			{
+				fprintf(stderr, "err: failed to read changes!\n");
+				goto done;
+			}
+			
+			for (ssize_t off = 0; off < len;)
+			{
+				struct inotify_event const *ev = (struct inotify_event const *)&evs.buf[off];
+				off += sizeof(struct inotify_event) + ev->len;
+				
+				// changes were lost, so anything may have changed.
+				if (ev->mask & IN_Q_OVERFLOW)
+				{
+					style_changed = docdata_changed = true;
+					timeout = WATCH_DEBOUNCE_MS;
+					continue;
+				}
+				
+				if (!ev->len)
+					continue;
+				
+				for (size_t i = 0; i < w.nfiles; ++i)
+				{
+					struct watch_file const *wf = &w.files[i];
+					if (wf->wd != ev->wd || strcmp(wf->name, ev->name))
+						continue;
+					
+					if (wf->kind == WK_STYLE)
+						style_changed = true;
+					else if (wf->kind == WK_DOCDATA)
+						docdata_changed = true;
+					else
+						dirty[wf->input] = true;
+					
+					timeout = WATCH_DEBOUNCE_MS;
+				}
+			}
+		}
+		
+		double start = secs_now();
+		file_data.read_secs = file_data.parse_secs = 0;
+		
+		// reload changed shared files, which every document depends on.
+		if (style_changed || docdata_changed)
+		{
+			bool failed = false;
+			
+			struct file_buf *bufs[] = {&file_data.style, &file_data.docdata};
+			char const *files[] = {conf.style_file, conf.docdata_file};
+			char const *kinds[] = {"style", "docdata"};
+			bool changed[] = {style_changed, docdata_changed};
+			
+			for (int i = 0; i < 2; ++i)
+			{
+				if (!files[i] || !changed[i])
+					continue;
+				
+				int fd = open(files[i], O_RDONLY);
+				if (fd == -1)
+				{
+					fprintf(stderr, "err: failed to open %s file for reading: %s!\n", kinds[i], files[i]);
+					failed = true;
+					continue;
+				}
+				
+				file_release(bufs[i]);
+				failed |= file_read(bufs[i], fd, files[i], kinds[i]) != 0;
+				close(fd);
+				
+				if (!failed && conf.minify && bufs[i] == &file_data.style)
+					style_minify(bufs[i]);
+			}
+			
+			file_data.read_secs = secs_now() - start;
+			
+			prepared = !failed && !file_data_prepare();
+			all_dirty = true;
+		}
+		
+		// documents cannot be compiled correctly until this is fixed.
+		if (!prepared)
+			continue;
+		
+		size_t ninputs = 0;
+		for (size_t i = 0; i < conf.ninputs; ++i)
+		{
+			if (dirty[i] || all_dirty)
+				inputs[ninputs++] = i;
+			dirty[i] = false;
+		}
+		
+		struct compile_job_arg arg =
+		{
+			.inputs = inputs,
+			.rcs = rcs,
+		};
+		cmfc_pool_run(ninputs, conf.njobs, doc_compile_job, &arg);
+		
+		if (conf.index_file)
+			index_write();
+		
+		if (conf.stats)
+			stats_report(inputs, ninputs, secs_now() - start);
+	}
+	
+done:
+	free(rcs);
+	free(inputs);
+	free(dirty);
+	watch_release(&w);
+	
+	return rc;
+}
+
+// order words as `strcmp()` would.
+static int
+word_cmp(char const *a, size_t a_len, char const *b, size_t b_len)
+{
+	int cmp = memcmp(a, b, a_len < b_len ? a_len : b_len);
+	return cmp ? cmp : (a_len > b_len) - (a_len < b_len);
+}
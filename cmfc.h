@@ -0,0 +1,266 @@
+#ifndef CMFC_H
+#define CMFC_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// initial value for `cmfc_hash()`.
+#define CMFC_HASH_INIT 0xcbf29ce484222325ull
+
+// number of node types counted in `struct cmfc_stats`.
+#define CMFC_NODE_TYPES 13
+
+// deepest list item accepted, each level of depth being generated as a list of
+// its own. markup nesting lists any deeper is an error.
+#define CMFC_MAX_LIST_DEPTH 32
+
+enum cmfc_status
+{
+	CMFC_OK = 0,
+	CMFC_ERR, // the markup or docdata is invalid, described by the error.
+	CMFC_ERR_IO, // a read or write callback failed, and reported it itself.
+	CMFC_ERR_SPACE, // the caller's output buffer is too small.
+};
+
+// a compile error. errors found at a position in the markup carry it, along
+// with the line of markup found there. the library never exits or prints on
+// its own: a compile which runs out of memory for its nodes and strings fails
+// with CMFC_ERR and the message "out of memory".
+struct cmfc_error
+{
+	char const *file;
+	bool has_pos;
+	size_t pos;
+	char msg[128];
+	char line[1024];
+};
+
+// the state left by a docdata file, which documents compiled with it start in.
+struct cmfc_docdata;
+
+// a parsed document loaded from its binary AST, which it is rendered from in
+// place.
+struct cmfc_ast;
+
+// a gzip compressor, passing the compressed data on to a write callback.
+struct cmfc_gzip;
+
+// measurements of a single compile. times are in seconds; memory is that held
+// by the compile's nodes, strings and buffers, not counting the markup.
+struct cmfc_stats
+{
+	double parse_secs; // includes HTMLification of text.
+	double verify_secs; // checking the DOC directives.
+	double gen_secs; // generating HTML or dumping the AST.
+
+	// nodes parsed, indexed by type. see `cmfc_node_type_name()`.
+	uint64_t nodes[CMFC_NODE_TYPES];
+
+	uint64_t bytes_in, bytes_out;
+	uint64_t allocs; // node and string allocations.
+	uint64_t peak_mem;
+};
+
+// called with each word of a document's text, lowercased, as its output is
+// generated. the word is not null-terminated.
+typedef void (*cmfc_word_fn)(void *user, char const *word, size_t len);
+
+struct cmfc_opts
+{
+	char const *file; // name of the markup, as used in errors.
+
+	// stylesheet embedded into the output, if not NULL.
+	char const *style;
+	size_t style_len;
+
+	// URL of a stylesheet linked to from the output, if not NULL, written as
+	// given. it may be used together with `style`, e.g. embedding only the
+	// critical subset of the stylesheet it links to.
+	char const *style_href;
+
+	struct cmfc_docdata const *docdata; // NULL to start from a clean state.
+	int jobs; // number of threads large documents may be parsed with.
+	bool dump_ast; // output the AST of the markup rather than HTML.
+
+	// number footnotes in order of their first mention, replacing the text of
+	// references with the number and prefixing definitions with it. documents
+	// are then parsed on a single thread and never compiled incrementally.
+	bool renumber_footnotes;
+
+	// give titles ids derived from their text, unique within the document and
+	// distinct from the names of its footnotes. a table of contents, which
+	// implies ids, begins the body with a nested list of links to the titles.
+	// it cannot be streamed.
+	bool heading_ids;
+	bool toc;
+
+	// if not NULL, the words of the title and subtitle, titles, paragraphs,
+	// list items, table cells, blockquotes and footnotes are passed to `word`.
+	// words are runs of letters, digits, underscores and non-ASCII characters,
+	// leaving out apostrophes. markup separates them. such documents are never
+	// compiled incrementally.
+	cmfc_word_fn word;
+	void *word_user;
+
+	// leave out the whitespace between tags which the output does not need.
+	// that after images, which are inline, is kept as a single space. text,
+	// e.g. that of long code blocks, is output as it is, as is the stylesheet,
+	// which may be minified with `cmfc_style_minify()` beforehand.
+	bool minify;
+
+	// if not 0, compiles whose output would exceed this many bytes fail with an
+	// error instead. streamed output written before then is not withheld.
+	size_t max_out;
+
+	struct cmfc_stats *stats; // filled in by the compile, if not NULL.
+};
+
+// output fragment produced from a top-level block, for use in incremental
+// compilation. `off` and `len` locate the fragment in the output.
+struct cmfc_frag
+{
+	uint64_t key;
+	uint64_t off, len;
+};
+
+// the output and fragments of a previous compile of a document.
+struct cmfc_prev
+{
+	char const *out;
+	size_t out_len;
+	struct cmfc_frag const *frags;
+	size_t nfrags;
+};
+
+// output is passed to write callbacks as it is produced, which return nonzero
+// on failure. read callbacks return the number of bytes read, 0 at the end of
+// the input, or -1 on failure.
+typedef int (*cmfc_write_fn)(void *user, char const *data, size_t len);
+typedef long (*cmfc_read_fn)(void *user, char *buf, size_t cap);
+
+// markup and docdata passed in memory must be null-terminated, i.e. the byte
+// at `len` must be 0.
+
+// compile markup, passing the output to `write` in one call.
+int cmfc_compile(struct cmfc_opts const *opts,
+                 char const *markup,
+                 size_t len,
+                 cmfc_write_fn write,
+                 void *user,
+                 struct cmfc_error *err);
+
+// compile markup into a caller-supplied buffer. on success, or if the buffer
+// is too small, `out_len` is set to the length of the output.
+int cmfc_compile_buf(struct cmfc_opts const *opts,
+                     char const *markup,
+                     size_t len,
+                     char *buf,
+                     size_t cap,
+                     size_t *out_len,
+                     struct cmfc_error *err);
+
+// compile markup like `cmfc_compile()`, reusing the output of blocks unchanged
+// since a previous compile, if any. the previous compile must have been made
+// with the same options and build of the library, as fragments are only keyed
+// by their markup. on success, the fragments of the output are returned in
+// `frags`, which must be freed with `free()`. AST dumps produce no fragments.
+int cmfc_compile_incremental(struct cmfc_opts const *opts,
+                             char const *markup,
+                             size_t len,
+                             struct cmfc_prev const *prev,
+                             struct cmfc_frag **frags,
+                             size_t *nfrags,
+                             cmfc_write_fn write,
+                             void *user,
+                             struct cmfc_error *err);
+
+// compile markup block by block as it is read, passing the output of each
+// block to `write` soon after it is read. memory use is bounded by the largest
+// block. DOC directives other than DOC-LICENSE must precede all content.
+int cmfc_stream(struct cmfc_opts const *opts,
+                cmfc_read_fn read,
+                void *read_user,
+                cmfc_write_fn write,
+                void *write_user,
+                struct cmfc_error *err);
+
+// parse markup and pass its binary AST to `write` in one call. the AST holds
+// the nodes and DOC directives of the document as a single blob of offsets and
+// strings, and can only be loaded by builds of the library with the same byte
+// order and pointer size.
+int cmfc_serialize(struct cmfc_opts const *opts,
+                   char const *markup,
+                   size_t len,
+                   cmfc_write_fn write,
+                   void *user,
+                   struct cmfc_error *err);
+
+// whether data begins like a binary AST rather than markup.
+bool cmfc_is_ast(void const *data, size_t len);
+
+// load a binary AST without allocating per node: its offsets are validated and
+// then replaced by pointers in place. the blob must be writable, aligned to 8
+// bytes and outlive the AST. it is left untouched if it is found to be invalid,
+// in which case NULL is returned.
+struct cmfc_ast *cmfc_ast_load(void *blob, size_t len, char const *file, struct cmfc_error *err);
+
+// render a loaded AST as `cmfc_compile()` would have rendered its markup. the
+// docdata and number of jobs in the options are ignored, the docdata having
+// been applied when the markup was parsed. if the output would exceed
+// `max_out`, nothing is written and CMFC_ERR is returned.
+int cmfc_ast_render(struct cmfc_opts const *opts,
+                    struct cmfc_ast const *ast,
+                    cmfc_write_fn write,
+                    void *user,
+                    struct cmfc_error *err);
+void cmfc_ast_free(struct cmfc_ast *ast);
+
+// start a gzip stream whose compressed data is passed to `write`, in chunks of
+// up to a few hundred kilobytes. data is compressed with the built-in deflate
+// implementation.
+struct cmfc_gzip *cmfc_gzip_new(cmfc_write_fn write, void *user);
+
+// compress more data. this is itself a write callback, taking the stream as
+// `user`, so output may be compressed as it is compiled.
+int cmfc_gzip_write(void *user, char const *data, size_t len);
+
+// compress the rest of the data and end the stream. streams must be freed with
+// `cmfc_gzip_free()` whether they are finished or abandoned.
+int cmfc_gzip_finish(struct cmfc_gzip *gz);
+void cmfc_gzip_free(struct cmfc_gzip *gz);
+
+// copy the critical subset of a stylesheet into `buf`, which must hold `len`
+// bytes, returning its length. this is the rules which style the page itself
+// and its header, i.e. whose selectors are all `*`, `:root`, `html`, `body` or
+// the `doc-` classes of the header, so that pages embedding it can be laid out
+// before the rest of the stylesheet is loaded. at-rules are left out.
+size_t cmfc_style_critical(char const *style, size_t len, char *buf);
+
+// copy a stylesheet into `buf`, which must hold `len` bytes, with its comments
+// and the whitespace it does not need left out, returning its length. strings
+// and escapes are left as they are.
+size_t cmfc_style_minify(char const *style, size_t len, char *buf);
+
+// parse a docdata file. returns NULL on failure.
+struct cmfc_docdata *cmfc_docdata_new(char const *data, size_t len, char const *file, struct cmfc_error *err);
+void cmfc_docdata_free(struct cmfc_docdata *dd);
+
+// format an error as a diagnostic message, as `snprintf()` would.
+int cmfc_error_format(char *buf, size_t size, struct cmfc_error const *err);
+
+// name of a node type counted in `struct cmfc_stats`, as used in AST dumps.
+char const *cmfc_node_type_name(int type);
+
+// continue the hash `h` with more data.
+uint64_t cmfc_hash(uint64_t h, void const *data, size_t n);
+
+// run jobs 0 to `njobs` - 1 on up to `nthreads` threads, balancing them by work
+// stealing. `fn` is called with `arg`, the job, and the index of the thread.
+void cmfc_pool_run(size_t njobs, int nthreads, void (*fn)(void *, size_t, int), void *arg);
+
+// identifies the source the library was built from, whose output may differ
+// between versions. builds of the same source share the same version.
+char const *cmfc_version(void);
+
+#endif
@@ -0,0 +1,5300 @@
+#include <ctype.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <pthread.h>
+
+#include "cmfc.h"
+
+#define ALIGN_UP(n, align) (((n) + (align) - 1) / (align) * (align))
+
+// append a string literal to an output buffer, its length known at compile time.
+// its newlines only separate tags, so they are left out of minified output.
+#define OUT_LIT(ob, lit) \
+	((ob)->minify ? out_minified((ob), (lit), sizeof(lit) - 1) : out_append((ob), (lit), sizeof(lit) - 1))
+
+// the value of a macro as a string literal.
+#define STRINGIFY(x) STRINGIFY_(x)
+#define STRINGIFY_(x) #x
+
+// documents at least this large are parsed by multiple threads when possible,
+// in jobs of at least this many bytes worth of blocks.
+#define PARALLEL_PARSE_MIN 1048576
+#define PARALLEL_PARSE_CHUNK 65536
+
+// streamed input is read in chunks of at least STREAM_CHUNK bytes. a block is
+// only considered complete once at least STREAM_LOOKAHEAD bytes follow it, as
+// the parser peeks up to that far ahead to find boundaries. STREAM_PAD null
+// bytes follow the buffered input to keep such peeks in bounds.
+#define STREAM_CHUNK 65536
+#define STREAM_FLUSH 65536
+#define STREAM_LOOKAHEAD 8
+#define STREAM_PAD 16
+
+// identifies the source of the build, as it determines the output. the
+// makefile passes a checksum of the library's source, so that builds of the
+// same source share caches.
+#ifndef VERSION
+#define VERSION "unversioned"
+#endif
+
+// binary ASTs begin with AST_MAGIC, whose leading null byte no markup begins
+// with. AST_ORDER is written in the producer's byte order.
+#define AST_MAGIC "\0cmfcast"
+#define AST_ORDER 0x01020304
+#define AST_DOC_FIELDS 7
+
+// gzip streams are compressed in deflate blocks of up to GZ_BLOCK bytes of
+// input, matched against the preceding GZ_WINDOW bytes. up to GZ_CHAIN earlier
+// positions are tried per match, and matches shorter than GZ_LAZY_MAX are
+// passed over if a longer one begins at the next byte.
+#define GZ_BLOCK 131072
+#define GZ_WINDOW 32768
+#define GZ_HASH_SIZE 32768
+#define GZ_CHAIN 64
+#define GZ_LAZY_MAX 32
+#define GZ_MIN_MATCH 3
+#define GZ_MAX_MATCH 258
+#define GZ_MAX_BITS 15
+#define GZ_NLITS 286
+#define GZ_NLENS 29
+#define GZ_NDISTS 30
+#define GZ_NCLENS 19
+
+#define ARENA_ALIGN 16
+#define ARENA_BLOCK_SIZE 65536
+#define ARENA_MIN_CLASS 16
+#define ARENA_NCLASSES 48
+
+// text - used for normal textual website data.
+// raw - used for links and URLS.
+#define HS_IS_TEXT(hstate) !HS_IS_RAW(hstate)
+#define HS_IS_RAW(hstate) ((hstate) & (HS_LINK_REF | HS_FORCE_RAW | HS_FOOTNOTE_REF))
+
+enum node_type
+{
+	NT_ROOT = 0,
+	NT_TITLE,
+	NT_PARAGRAPH,
+	NT_U_LIST,
+	NT_O_LIST,
+	NT_LIST_ITEM,
+	NT_IMAGE,
+	NT_BLOCKQUOTE,
+	NT_TABLE,
+	NT_TABLE_ROW,
+	NT_TABLE_ITEM,
+	NT_FOOTNOTE,
+	NT_LONG_CODE,
+};
+
+enum parse_status
+{
+	PS_OK = 0,
+	PS_ERR,
+	PS_SKIP,
+};
+
+// what a document is compiled into.
+enum doc_format
+{
+	DF_HTML = 0,
+	DF_AST_DUMP,
+	DF_AST_BLOB,
+};
+
+// boundaries at which a block's text can end, each beginning with a newline.
+enum block_end
+{
+	BE_BLANK = 0x1, // "\n\n".
+	BE_INDENT = 0x2, // "\n    ".
+	BE_U_ITEM = 0x4, // "\n*".
+	BE_O_ITEM = 0x8, // "\n#".
+	BE_CODE_FENCE = 0x10, // "\n```".
+};
+
+enum htmlify_state
+{
+	HS_NONE = 0x0,
+	HS_LINK_REF = 0x1,
+	HS_LINK_TEXT = 0x2,
+	HS_CODE = 0x4,
+	HS_ITALIC = 0x8,
+	HS_BOLD = 0x10,
+	HS_FORCE_RAW = 0x20,
+	HS_FOOTNOTE_REF = 0x40,
+	HS_FOOTNOTE_TEXT = 0x80,
+};
+
+struct node
+{
+	// how many strings of data are stored depends on the node in question.
+	// e.g. footnotes have two data strings, while paragraphs have one.
+	char *data[2];
+	
+	struct node *children;
+	size_t nchildren, children_cap;
+	int arg; // type-dependent argument.
+	unsigned char type;
+	bool raw_text; // whether its text was left raw rather than HTMLified.
+};
+
+struct doc_data
+{
+	char *title, *subtitle;
+	char *author;
+	char *created, *revised;
+	char *license;
+	char *favicon;
+	
+	// whether the title and subtitle were left raw rather than HTMLified.
+	bool raw_title, raw_subtitle;
+};
+
+// the output document is built up in memory and written out in one go. a
+// fixed buffer belongs to the caller and is never grown; output past its end is
+// only counted. output past the limit, if any, is dropped, failing the compile.
+// minified output leaves the newlines out of literals.
+struct out_buf
+{
+	char *data;
+	size_t len, cap;
+	size_t limit; // 0 if there is none.
+	size_t flushed; // bytes already passed on to the caller.
+	bool fixed;
+	bool over;
+	bool minify;
+};
+
+struct cell_buf
+{
+	size_t len, cap;
+};
+
+struct arena_block
+{
+	struct arena_block *next;
+	size_t size, used;
+};
+
+// bump allocator owning all nodes and strings of a document, released in one
+// step once the document is finished. growable allocations come in power of
+// two size classes; blocks outgrown by `arena_realloc()` are pooled for reuse.
+// allocations return NULL if out of memory, which fails the compile.
+struct arena
+{
+	struct arena_block *head;
+	void *free_lists[ARENA_NCLASSES];
+	
+	// for statistics: bytes of blocks held, and the number of allocations
+	// made, which is kept across releases.
+	size_t held;
+	size_t nallocs;
+};
+
+// a top-level block of a document, as found by the block indexing pass.
+struct block
+{
+	size_t begin, end;
+	unsigned char type;
+	bool raw_text; // raw text state in effect at the beginning of the block.
+};
+
+// a footnote definition or reference, as found while parsing. mentions are
+// only entered into the footnote table once the blocks they are from are known
+// to be complete, and then in the order they appear in the document.
+struct footnote_mention
+{
+	char const *name;
+	size_t pos;
+	bool def;
+};
+
+struct footnote_entry
+{
+	char const *name;
+	uint64_t hash;
+	bool defined, referenced;
+	
+	// the first reference, if it was made before the footnote was defined.
+	size_t ref_pos;
+	char const *ref_line;
+};
+
+// the footnotes of a document, numbered in order of their first mention and
+// indexed by an open addressed hash table of entry indices plus one. entries
+// from `ncommitted` on were added for a block which may yet be parsed again.
+struct footnote_table
+{
+	struct footnote_entry *entries;
+	size_t nentries, entries_cap, ncommitted;
+	size_t *slots;
+	size_t cap;
+	
+	// names of the footnotes, and when streaming, the lines of mentions which
+	// may be reported, as they outlive the blocks they are from.
+	struct arena arena;
+	bool keep_lines;
+	
+	// the first definition of a footnote already defined, if any.
+	bool dup;
+	size_t dup_pos;
+	char const *dup_line;
+};
+
+// a title given an id, or the id of a footnote, which no title may be given
+// and which has a level of 0. its text is only kept until the document is
+// generated.
+struct heading
+{
+	char const *id;
+	char const *text;
+	uint64_t hash;
+	int level;
+	
+	// the lowest suffix which may be free for titles repeating the id.
+	unsigned long suffix;
+};
+
+// the titles of a document in order, among the ids of its footnotes, with the
+// ids indexed by an open addressed hash table of heading indices plus one.
+struct heading_table
+{
+	struct heading *headings;
+	size_t nheadings, headings_cap;
+	size_t nfootnotes; // headings which are footnote ids.
+	size_t next; // the heading whose title is generated next.
+	size_t *slots;
+	size_t cap;
+	
+	// ids of the headings, as they outlive the blocks of streamed documents.
+	struct arena arena;
+};
+
+// all state belonging to the compilation of a single document, so that
+// multiple documents can be compiled concurrently.
+struct doc_ctx
+{
+	char const *markup_file;
+	char const *style; // NULL if there is no stylesheet.
+	size_t style_len;
+	char const *style_href; // NULL if no stylesheet is linked.
+	
+	struct out_buf out;
+	
+	// only the first error is kept, as parsing stops at it.
+	struct cmfc_error err;
+	bool err_set;
+	
+	struct doc_data doc_data;
+	struct node doc_root;
+	bool raw_text;
+	
+	struct arena arena;
+	
+	// reusable buffer into which strings are built before being copied into
+	// the arena.
+	char *scratch;
+	size_t scratch_cap;
+	
+	// lengths and capacities of the cells of the table row being parsed.
+	struct cell_buf *cells;
+	size_t cells_cap;
+	
+	// number of threads the markup may be parsed with, and the contexts of
+	// those threads, which own the memory of the nodes they parsed.
+	int parse_jobs;
+	struct doc_ctx *workers;
+	int nworkers;
+	
+	// when streaming, the markup is only a window into the document, which
+	// begins at `pos_base`.
+	size_t pos_base;
+	
+	// when compiling incrementally, the fragments of the output produced from
+	// each block, to be cached for the next compile.
+	struct cmfc_frag *frags;
+	size_t nfrags;
+	
+	// footnotes mentioned in the blocks parsed but not yet entered into the
+	// table, and whether footnotes are renumbered.
+	struct footnote_mention *fn_mentions;
+	size_t nfn_mentions, fn_mentions_cap;
+	struct footnote_table fn_table;
+	bool fn_renumber;
+	
+	// titles given ids, if they are, and whether the body begins with a table
+	// of contents linking to them.
+	struct heading_table headings;
+	bool heading_ids, toc;
+	
+	// called with each word of the text generated, if not NULL.
+	cmfc_word_fn word;
+	void *word_user;
+	
+	// NULL unless statistics of the compile were requested.
+	struct cmfc_stats *stats;
+};
+
+// a window into a streamed document, null-padded beyond its end.
+struct stream_buf
+{
+	char *data;
+	size_t len, cap;
+	size_t pos; // beginning of the next block to parse.
+	bool eof;
+};
+
+struct cmfc_docdata
+{
+	struct doc_ctx ctx;
+};
+
+// binary ASTs consist of this header, the nodes as slots in breadth-first
+// order, then the strings they reference, and a final null byte. offsets are
+// from the beginning of the blob, 0 standing for NULL.
+struct ast_header
+{
+	char magic[8];
+	uint32_t order;
+	uint32_t slot_size; // differs between ABIs, which cannot share ASTs.
+	uint64_t len;
+	uint64_t nnodes;
+	uint64_t doc_data[AST_DOC_FIELDS];
+	uint8_t raw_title, raw_subtitle;
+};
+
+struct ast_node
+{
+	uint64_t data[2];
+	uint64_t children;
+	uint64_t nchildren;
+	int32_t arg;
+	uint8_t type;
+	uint8_t raw_text;
+};
+
+// each serialized node is overwritten by the node it describes when loaded.
+union ast_slot
+{
+	struct ast_node ser;
+	struct node node;
+};
+
+struct cmfc_ast
+{
+	struct node const *root;
+	struct doc_data doc_data;
+	size_t len;
+};
+
+// a literal byte if `dist` is 0, otherwise a match of `litlen` bytes.
+struct gz_sym
+{
+	uint16_t litlen;
+	uint16_t dist;
+};
+
+struct gz_match
+{
+	size_t len, dist;
+};
+
+struct gz_huff_sym
+{
+	uint32_t freq;
+	int sym;
+};
+
+struct cmfc_gzip
+{
+	cmfc_write_fn write;
+	void *user;
+	bool failed;
+	
+	// up to GZ_WINDOW bytes of history, followed by the input not yet
+	// compressed from `in_pos` on.
+	unsigned char *in;
+	size_t in_len, in_pos;
+	
+	// hash chains of the positions in the input, linking each position to the
+	// previous one with the same first bytes, or -1.
+	int32_t *head;
+	int32_t *prev;
+	
+	struct gz_sym *syms;
+	size_t nsyms;
+	
+	// compressed data not yet passed on, and bits not yet making up a byte.
+	unsigned char *out;
+	size_t out_len, out_cap;
+	uint64_t bits;
+	int nbits;
+	
+	uint32_t crc;
+	uint32_t size;
+	uint32_t crc_table[256];
+};
+
+// the fragments of a previous compile, indexed by an open addressed hash table
+// of fragment indices plus one.
+struct frag_table
+{
+	struct cmfc_frag const *frags;
+	size_t *slots;
+	size_t cap;
+};
+
+struct parse_job_arg
+{
+	struct doc_ctx *ctx;
+	struct block const *blocks;
+	size_t const *chunks;
+	struct node *nodes;
+	char const *data;
+	size_t len;
+	char const *file;
+	int *rcs;
+	struct cmfc_error *errs;
+};
+
+// a range of job indices owned by a pool worker; the owner takes jobs from the
+// front while idle workers steal from the back.
+struct pool_deque
+{
+	pthread_mutex_t lock;
+	size_t head, tail;
+};
+
+struct pool
+{
+	struct pool_deque *deques;
+	int nworkers;
+	void (*fn)(void *, size_t, int);
+	void *arg;
+};
+
+struct pool_worker_arg
+{
+	struct pool *pool;
+	int id;
+};
+
+static void *arena_alloc(struct arena *a, size_t size);
+static struct arena_block *arena_block_new(size_t size);
+static int arena_class(size_t size);
+static void *arena_realloc(struct arena *a, void *ptr, size_t old_size, size_t new_size);
+static void arena_release(struct arena *a);
+static char *arena_strndup(struct arena *a, char const *s, size_t n);
+static char const *ast_check(char const *blob, size_t len);
+static bool ast_str_ok(uint64_t off, size_t str_off, size_t len);
+static uint64_t ast_str_take(char const *s, size_t *str_off);
+static void ast_write(struct doc_ctx *ctx);
+static size_t block_end(char const *data, size_t i, unsigned ends);
+static enum node_type block_type(char const *data, size_t i);
+static int doc_build(struct doc_ctx *ctx, char const *markup, size_t len, enum doc_format fmt);
+static void doc_ctx_init(struct doc_ctx *ctx, struct cmfc_opts const *opts);
+static void doc_ctx_release(struct doc_ctx *ctx);
+static void doc_data_fields(struct doc_data *dd, char **fields[AST_DOC_FIELDS]);
+static int doc_data_verify(struct doc_ctx *ctx);
+static void doc_err(struct doc_ctx *ctx, char const *msg);
+static int doc_incremental(struct doc_ctx *ctx, char const *markup, size_t len, struct cmfc_prev const *prev);
+static enum parse_status doc_oom(struct doc_ctx *ctx);
+static int doc_stream(struct doc_ctx *ctx, cmfc_read_fn read, void *read_user, cmfc_write_fn write, void *write_user, bool dump_ast);
+static char const *entity_char(char ch);
+static int footnote_check(struct doc_ctx *ctx, char const *data);
+static int footnote_commit(struct doc_ctx *ctx, char const *data);
+static bool footnote_in_block(char const *data, struct block const *b);
+static size_t footnote_intern(struct footnote_table *ft, char const *name, size_t len);
+static size_t footnote_mention(struct doc_ctx *ctx, char const *name, size_t len, size_t pos, bool def);
+static int footnote_mention_cmp(void const *a, void const *b);
+static void footnote_table_release(struct footnote_table *ft);
+static void footnote_table_truncate(struct footnote_table *ft, size_t nentries);
+static struct cmfc_frag const *frag_find(struct frag_table const *ft, uint64_t key);
+static uint64_t frag_key(struct block const *b, char const *data, size_t len);
+static void frag_table_init(struct frag_table *ft, struct cmfc_prev const *prev);
+static int gen_html(struct doc_ctx *ctx);
+static void gen_html_foot(struct doc_ctx *ctx);
+static void gen_html_head(struct doc_ctx *ctx);
+static void gen_blockquote_html(struct doc_ctx *ctx, struct node const *node);
+static void gen_footnote_html(struct doc_ctx *ctx, struct node const *node);
+static void gen_image_html(struct doc_ctx *ctx, struct node const *node);
+static void gen_long_code_html(struct doc_ctx *ctx, struct node const *node);
+static void gen_node_html(struct doc_ctx *ctx, struct node const *node);
+static void gen_o_list_html(struct doc_ctx *ctx, struct node const *node);
+static void gen_paragraph_html(struct doc_ctx *ctx, struct node const *node);
+static void gen_table_html(struct doc_ctx *ctx, struct node const *node);
+static void gen_title_html(struct doc_ctx *ctx, struct node const *node);
+static void gen_toc_html(struct doc_ctx *ctx);
+static void gen_u_list_html(struct doc_ctx *ctx, struct node const *node);
+static int gz_block(struct cmfc_gzip *gz, bool final);
+static int gz_code(uint16_t const *base, int n, unsigned v);
+static struct gz_match gz_find(struct cmfc_gzip const *gz, size_t i);
+static int gz_flush(struct cmfc_gzip *gz);
+static unsigned gz_hash(unsigned char const *s);
+static void gz_huff_codes(uint32_t const *freq, int n, int max_len, unsigned char *lens, uint16_t *codes);
+static int gz_huff_sym_cmp(void const *a, void const *b);
+static void gz_insert(struct cmfc_gzip *gz, size_t i);
+static void gz_put_bits(struct cmfc_gzip *gz, unsigned bits, int n);
+static size_t hash_slot(uint64_t hash, size_t cap);
+static int heading_add(struct heading_table *ht, struct node const *node);
+static int heading_grow(struct heading_table *ht);
+static int heading_reserve(struct heading_table *ht, char const *id);
+static size_t heading_slot(struct heading_table const *ht, char const *id, uint64_t hash);
+static void heading_table_release(struct heading_table *ht);
+#ifdef HTMLIFY_CHECK
+static void htmlify_check(struct doc_ctx *ctx, char const *s, size_t lb, size_t ub, enum htmlify_state hstate);
+static char *htmlify_ref(bool raw_text, char const *s, size_t lb, size_t ub, enum htmlify_state hstate);
+#endif
+static size_t htmlify(struct doc_ctx *ctx, char const *s, size_t lb, size_t ub, enum htmlify_state hstate);
+static char *htmlified_substr(struct doc_ctx *ctx, char const *s, size_t lb, size_t ub, enum htmlify_state hstate);
+static int node_add_child(struct doc_ctx *ctx, struct node *node, struct node *child);
+static void node_print(struct out_buf *ob, struct node const *node, int depth);
+static void node_words(struct doc_ctx *ctx, struct node const *node, bool raw_text);
+static void out_append(struct out_buf *ob, char const *s, size_t n);
+static int out_flush(struct out_buf *ob, cmfc_write_fn write, void *user);
+static int out_limit_check(struct doc_ctx *ctx);
+static void out_minified(struct out_buf *ob, char const *s, size_t n);
+static void out_str(struct out_buf *ob, char const *s);
+static int parse(struct doc_ctx *ctx, struct node *out, char const *data, size_t len, char const *file);
+static enum parse_status parse_any(struct doc_ctx *ctx, struct node *out, size_t *i, char const *data, size_t len, char const *file);
+static int parse_blocks(struct doc_ctx *ctx, struct node *nodes, struct block const *blocks, size_t nblocks, char const *data, size_t len, char const *file, int njobs);
+static enum parse_status parse_blockquote(struct doc_ctx *ctx, struct node *out, size_t *i, char const *data);
+static enum parse_status parse_doc(struct doc_ctx *ctx, size_t *i, char const *data, char const *file);
+static enum parse_status parse_footnote(struct doc_ctx *ctx, struct node *out, size_t *i, char const *data, size_t len);
+static int parse_index(struct doc_ctx *ctx, struct block **out, size_t *out_len, char const *data, size_t len, char const *file);
+static enum parse_status parse_image(struct doc_ctx *ctx, struct node *out, size_t *i, char const *data);
+static enum parse_status parse_long_code(struct doc_ctx *ctx, struct node *out, size_t *i, char const *data);
+static int parse_parallel(struct doc_ctx *ctx, struct node *out, char const *data, size_t len, char const *file);
+static void parse_parallel_job(void *arg, size_t job, int worker);
+static enum parse_status parse_o_list(struct doc_ctx *ctx, struct node *out, size_t *i, char const *data, size_t len, char const *file);
+static enum parse_status parse_paragraph(struct doc_ctx *ctx, struct node *out, size_t *i, char const *data);
+static enum parse_status parse_table(struct doc_ctx *ctx, struct node *out, size_t *i, char const *data, size_t len, char const *file);
+static enum parse_status parse_table_row(struct doc_ctx *ctx, struct node *out, size_t *i, char const *data, size_t len, char const *file);
+static enum parse_status parse_title(struct doc_ctx *ctx, struct node *out, size_t *i, char const *data, char const *file);
+static enum parse_status parse_u_list(struct doc_ctx *ctx, struct node *out, size_t *i, char const *data, size_t len, char const *file);
+static void *pool_worker(void *arg);
+static void prog_err(struct doc_ctx *ctx, char const *file, char const *data, size_t start, char const *msg);
+static char const *single_line(char *buf, size_t size, char const *s, size_t start);
+static double stats_clock(struct doc_ctx const *ctx);
+static void stats_count_nodes(struct cmfc_stats *stats, struct node const *node);
+static void stats_finish(struct doc_ctx *ctx, size_t in_len, size_t out_len);
+static size_t stats_mem(struct doc_ctx const *ctx);
+static void stats_sample_mem(struct doc_ctx *ctx, size_t extra);
+static int stream_read(struct stream_buf *sb, cmfc_read_fn read, void *user);
+static void str_dyn_append_s(char **str, size_t *len, size_t *cap, char const *s);
+static void str_dyn_append_c(char **str, size_t *len, size_t *cap, char c);
+static void str_dyn_append_n(char **str, size_t *len, size_t *cap, char const *s, size_t n);
+static size_t style_skip(char const *style, size_t len, size_t i, char const *stops);
+static bool style_rule_critical(char const *prelude, size_t len);
+static size_t text_word(char const *s, size_t *i, char *buf, bool raw_text);
+static void text_words(struct doc_ctx *ctx, char const *s, bool raw_text);
+
+#ifdef CMFC_BENCH
+// lets benchmarks time parsing apart from the HTMLification done during it.
+static bool bench_no_htmlify;
+#endif
+
+static char const *node_type_names[CMFC_NODE_TYPES] =
+{
+	"NT_ROOT",
+	"NT_TITLE",
+	"NT_PARAGRAPH",
+	"NT_U_LIST",
+	"NT_O_LIST",
+	"NT_LIST_ITEM",
+	"NT_IMAGE",
+	"NT_BLOCKQUOTE",
+	"NT_TABLE",
+	"NT_TABLE_ROW",
+	"NT_TABLE_ITEM",
+	"NT_FOOTNOTE",
+	"NT_LONG_CODE",
+};
+
+// selectors of the page itself and its header. rules selecting only these
+// make up the critical subset of a stylesheet.
+static char const *style_critical_sels[] =
+{
+	"*", ":root", "html", "body", ".doc-author", ".doc-date", ".doc-title", ".doc-subtitle",
+};
+
+// base values and extra bits of deflate's length and distance codes.
+static uint16_t const gz_len_base[GZ_NLENS] =
+{
+	3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83,
+	99, 115, 131, 163, 195, 227, 258,
+};
+static unsigned char const gz_len_extra[GZ_NLENS] =
+{
+	0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5,
+	0,
+};
+static uint16_t const gz_dist_base[GZ_NDISTS] =
+{
+	1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769,
+	1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577,
+};
+static unsigned char const gz_dist_extra[GZ_NDISTS] =
+{
+	0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11,
+	12, 12, 13, 13,
+};
+
+// bytes which may begin HTMLify markup or need escaping; anything else is
+// copied through verbatim.
+static unsigned char const htmlify_special[256] =
+{
+	['\\'] = 1, ['@'] = 1, ['['] = 1, [']'] = 1, ['|'] = 1, ['`'] = 1, ['*'] = 1,
+	['<'] = 1, ['>'] = 1, ['&'] = 1, ['"'] = 1, ['\''] = 1, ['-'] = 1, ['/'] = 1,
+};
+
+int
+cmfc_compile(struct cmfc_opts const *opts,
+             char const *markup,
+             size_t len,
+             cmfc_write_fn write,
+             void *user,
+             struct cmfc_error *err)
+{
+	struct doc_ctx ctx;
+	doc_ctx_init(&ctx, opts);
+	
+	int rc = CMFC_ERR;
+	if (!doc_build(&ctx, markup, len, opts->dump_ast ? DF_AST_DUMP : DF_HTML))
+		rc = write(user, ctx.out.data, ctx.out.len) ? CMFC_ERR_IO : CMFC_OK;
+	
+	if (rc == CMFC_ERR && err)
+		*err = ctx.err;
+	
+	stats_finish(&ctx, len, ctx.out.len);
+	doc_ctx_release(&ctx);
+	
+	return rc;
+}
+
+int
+cmfc_compile_buf(struct cmfc_opts const *opts,
+                 char const *markup,
+                 size_t len,
+                 char *buf,
+                 size_t cap,
+                 size_t *out_len,
+                 struct cmfc_error *err)
+{
+	struct doc_ctx ctx;
+	doc_ctx_init(&ctx, opts);
+	
+	// the output is generated straight into the caller's buffer.
+	ctx.out = (struct out_buf)
+	{
+		.data = buf,
+		.cap = cap,
+		.limit = ctx.out.limit,
+		.fixed = true,
+		.minify = ctx.out.minify,
+	};
+	
+	int rc = CMFC_ERR;
+	if (!doc_build(&ctx, markup, len, opts->dump_ast ? DF_AST_DUMP : DF_HTML))
+	{
+		*out_len = ctx.out.len;
+		rc = ctx.out.len > cap ? CMFC_ERR_SPACE : CMFC_OK;
+	}
+	
+	if (rc == CMFC_ERR && err)
+		*err = ctx.err;
+	
+	stats_finish(&ctx, len, ctx.out.len);
+	ctx.out = (struct out_buf){0};
+	doc_ctx_release(&ctx);
+	
+	return rc;
+}
+
+int
+cmfc_compile_incremental(struct cmfc_opts const *opts,
+                         char const *markup,
+                         size_t len,
+                         struct cmfc_prev const *prev,
+                         struct cmfc_frag **frags,
+                         size_t *nfrags,
+                         cmfc_write_fn write,
+                         void *user,
+                         struct cmfc_error *err)
+{
+	*frags = NULL;
+	*nfrags = 0;
+	
+	// the numbers of renumbered footnotes depend on the whole document, so the
+	// output of no block can be reused. nor can it be when the words of every
+	// block are wanted.
+	if (opts->dump_ast || opts->renumber_footnotes || opts->word)
+		return cmfc_compile(opts, markup, len, write, user, err);
+	
+	struct doc_ctx ctx;
+	doc_ctx_init(&ctx, opts);
+	
+	int rc = CMFC_ERR;
+	if (!doc_incremental(&ctx, markup, len, prev))
+		rc = write(user, ctx.out.data, ctx.out.len) ? CMFC_ERR_IO : CMFC_OK;
+	
+	if (rc == CMFC_OK)
+	{
+		*frags = ctx.frags;
+		*nfrags = ctx.nfrags;
+		ctx.frags = NULL;
+	}
+	else if (rc == CMFC_ERR && err)
+		*err = ctx.err;
+	
+	stats_finish(&ctx, len, ctx.out.len);
+	doc_ctx_release(&ctx);
+	
+	return rc;
+}
+
+int
+cmfc_stream(struct cmfc_opts const *opts,
+            cmfc_read_fn read,
+            void *read_user,
+            cmfc_write_fn write,
+            void *write_user,
+            struct cmfc_error *err)
+{
+	struct doc_ctx ctx;
+	doc_ctx_init(&ctx, opts);
+	
+	int rc = doc_stream(&ctx, read, read_user, write, write_user, opts->dump_ast);
+	if (rc == CMFC_ERR && err)
+		*err = ctx.err;
+	
+	doc_ctx_release(&ctx);
+	
+	return rc;
+}
+
+int
+cmfc_serialize(struct cmfc_opts const *opts,
+               char const *markup,
+               size_t len,
+               cmfc_write_fn write,
+               void *user,
+               struct cmfc_error *err)
+{
+	struct doc_ctx ctx;
+	doc_ctx_init(&ctx, opts);
+	
+	int rc = CMFC_ERR;
+	if (!doc_build(&ctx, markup, len, DF_AST_BLOB))
+		rc = write(user, ctx.out.data, ctx.out.len) ? CMFC_ERR_IO : CMFC_OK;
+	
+	if (rc == CMFC_ERR && err)
+		*err = ctx.err;
+	
+	stats_finish(&ctx, len, ctx.out.len);
+	doc_ctx_release(&ctx);
+	
+	return rc;
+}
+
+bool
+cmfc_is_ast(void const *data, size_t len)
+{
+	return len >= sizeof(AST_MAGIC) - 1 && !memcmp(data, AST_MAGIC, sizeof(AST_MAGIC) - 1);
+}
+
+struct cmfc_ast *
+cmfc_ast_load(void *blob, size_t len, char const *file, struct cmfc_error *err)
+{
+	char const *msg = ast_check(blob, len);
+	if (msg)
+	{
+		if (err)
+		{
+			*err = (struct cmfc_error)
+			{
+				.file = file ? file : "markup",
+			};
+			snprintf(err->msg, sizeof(err->msg), "%s", msg);
+		}
+		
+		return NULL;
+	}
+	
+	struct ast_header hdr;
+	memcpy(&hdr, blob, sizeof(hdr));
+	
+	struct cmfc_ast *ast = calloc(1, sizeof(struct cmfc_ast));
+	ast->len = len;
+	
+	char **fields[AST_DOC_FIELDS];
+	doc_data_fields(&ast->doc_data, fields);
+	for (size_t f = 0; f < AST_DOC_FIELDS; ++f)
+		*fields[f] = hdr.doc_data[f] ? (char *)blob + hdr.doc_data[f] : NULL;
+	ast->doc_data.raw_title = hdr.raw_title;
+	ast->doc_data.raw_subtitle = hdr.raw_subtitle;
+	
+	// swizzle the offsets of each slot into pointers.
+	union ast_slot *slots = (union ast_slot *)((char *)blob + ALIGN_UP(sizeof(struct ast_header), sizeof(uint64_t)));
+	for (size_t i = 0; i < hdr.nnodes; ++i)
+	{
+		struct ast_node sn = slots[i].ser;
+		slots[i].node = (struct node)
+		{
+			.data[0] = sn.data[0] ? (char *)blob + sn.data[0] : NULL,
+			.data[1] = sn.data[1] ? (char *)blob + sn.data[1] : NULL,
+			.children = sn.nchildren ? (struct node *)((char *)blob + sn.children) : NULL,
+			.nchildren = sn.nchildren,
+			.children_cap = sn.nchildren,
+			.arg = sn.arg,
+			.type = sn.type,
+			.raw_text = sn.raw_text,
+		};
+	}
+	ast->root = &slots[0].node;
+	
+	return ast;
+}
+
+int
+cmfc_ast_render(struct cmfc_opts const *opts,
+                struct cmfc_ast const *ast,
+                cmfc_write_fn write,
+                void *user,
+                struct cmfc_error *err)
+{
+	struct doc_ctx ctx;
+	doc_ctx_init(&ctx, opts);
+	ctx.doc_root = *ast->root;
+	ctx.doc_data = ast->doc_data;
+	
+	double t = stats_clock(&ctx);
+	int gen_rc = 0;
+	if (opts->dump_ast)
+		node_print(&ctx.out, &ctx.doc_root, 0);
+	else
+	{
+		ctx.out.cap = ast->len + ctx.style_len + 4096;
+		ctx.out.data = malloc(ctx.out.cap);
+		gen_rc = gen_html(&ctx);
+	}
+	
+	if (ctx.stats)
+	{
+		ctx.stats->gen_secs += stats_clock(&ctx) - t;
+		stats_count_nodes(ctx.stats, &ctx.doc_root);
+	}
+	
+	int rc = CMFC_ERR;
+	if (!gen_rc && !out_limit_check(&ctx))
+		rc = write(user, ctx.out.data, ctx.out.len) ? CMFC_ERR_IO : CMFC_OK;
+	
+	if (rc == CMFC_ERR && err)
+		*err = ctx.err;
+	
+	// the nodes belong to the blob.
+	stats_finish(&ctx, ast->len, ctx.out.len);
+	ctx.doc_root = (struct node){0};
+	doc_ctx_release(&ctx);
+	
+	return rc;
+}
+
+void
+cmfc_ast_free(struct cmfc_ast *ast)
+{
+	free(ast);
+}
+
+struct cmfc_gzip *
+cmfc_gzip_new(cmfc_write_fn write, void *user)
+{
+	struct cmfc_gzip *gz = malloc(sizeof(struct cmfc_gzip));
+	*gz = (struct cmfc_gzip)
+	{
+		.write = write,
+		.user = user,
+		.in = malloc(GZ_WINDOW + GZ_BLOCK),
+		.head = malloc(GZ_HASH_SIZE * sizeof(int32_t)),
+		.prev = malloc((GZ_WINDOW + GZ_BLOCK) * sizeof(int32_t)),
+		.syms = malloc((GZ_WINDOW + GZ_BLOCK) * sizeof(struct gz_sym)),
+		.out_cap = 4096,
+		.out = malloc(4096),
+	};
+	
+	for (size_t h = 0; h < GZ_HASH_SIZE; ++h)
+		gz->head[h] = -1;
+	
+	for (uint32_t i = 0; i < 256; ++i)
+	{
+		uint32_t c = i;
+		for (int b = 0; b < 8; ++b)
+			c = c & 1 ? 0xedb88320 ^ c >> 1 : c >> 1;
+		gz->crc_table[i] = c;
+	}
+	
+	// gzip header: deflate, no flags, no modification time, Unix.
+	static unsigned char const header[10] = {0x1f, 0x8b, 8, 0, 0, 0, 0, 0, 0, 3};
+	memcpy(gz->out, header, sizeof(header));
+	gz->out_len = sizeof(header);
+	
+	return gz;
+}
+
+int
+cmfc_gzip_write(void *user, char const *data, size_t len)
+{
+	struct cmfc_gzip *gz = user;
+	if (gz->failed)
+		return 1;
+	
+	uint32_t crc = ~gz->crc;
+	for (size_t i = 0; i < len; ++i)
+		crc = gz->crc_table[(crc ^ (unsigned char)data[i]) & 0xff] ^ crc >> 8;
+	gz->crc = ~crc;
+	gz->size += len;
+	
+	while (len)
+	{
+		size_t n = GZ_WINDOW + GZ_BLOCK - gz->in_len;
+		n = n < len ? n : len;
+		memcpy(&gz->in[gz->in_len], data, n);
+		gz->in_len += n;
+		data += n;
+		len -= n;
+		
+		if (gz->in_len == GZ_WINDOW + GZ_BLOCK && gz_block(gz, false))
+			return 1;
+	}
+	
+	return 0;
+}
+
+int
+cmfc_gzip_finish(struct cmfc_gzip *gz)
+{
+	if (gz->failed || gz_block(gz, true))
+		return 1;
+	
+	unsigned char trailer[8];
+	for (int i = 0; i < 4; ++i)
+	{
+		trailer[i] = gz->crc >> 8 * i;
+		trailer[4 + i] = gz->size >> 8 * i;
+	}
+	
+	memcpy(gz->out, trailer, sizeof(trailer));
+	gz->out_len = sizeof(trailer);
+	
+	return gz_flush(gz);
+}
+
+size_t
+cmfc_style_critical(char const *style, size_t len, char *buf)
+{
+	size_t out_len = 0, prev_end = 0;
+	for (size_t i = 0; i < len;)
+	{
+		// skip whitespace and comments between rules.
+		if (isspace((unsigned char)style[i]))
+		{
+			++i;
+			continue;
+		}
+		if (style[i] == '/' && i + 1 < len && style[i + 1] == '*')
+		{
+			for (i += 2; i + 1 < len && !(style[i] == '*' && style[i + 1] == '/'); ++i)
+				;
+			i = i + 2 < len ? i + 2 : len;
+			continue;
+		}
+		
+		// a rule runs up to the end of its block, or of its statement for
+		// at-rules without one.
+		size_t begin = i;
+		i = style_skip(style, len, i, "{;");
+		size_t prelude_end = i;
+		bool block = i < len && style[i] == '{';
+		if (block)
+		{
+			for (int depth = 0; i < len; ++i)
+			{
+				i = style_skip(style, len, i, "{}");
+				if (i == len)
+					break;
+				depth += style[i] == '{' ? 1 : -1;
+				if (!depth)
+					break;
+			}
+		}
+		i = i < len ? i + 1 : len;
+		
+		if (!block || style[begin] == '@' || !style_rule_critical(&style[begin], prelude_end - begin))
+		{
+			prev_end = i;
+			continue;
+		}
+		
+		// rules are kept apart by a newline in place of whatever separated
+		// them, so the subset is never longer than the stylesheet.
+		if (out_len && begin > prev_end)
+			buf[out_len++] = '\n';
+		memcpy(&buf[out_len], &style[begin], i - begin);
+		out_len += i - begin;
+		prev_end = i;
+	}
+	
+	return out_len;
+}
+
+size_t
+cmfc_style_minify(char const *style, size_t len, char *buf)
+{
+	size_t out_len = 0;
+	bool space = false;
+	char prev = 0; // the last character copied, if punctuation.
+	for (size_t i = 0; i < len;)
+	{
+		// comments are taken as whitespace, which may separate tokens.
+		if (isspace((unsigned char)style[i]))
+		{
+			space = true;
+			++i;
+			continue;
+		}
+		if (style[i] == '/' && i + 1 < len && style[i + 1] == '*')
+		{
+			for (i += 2; i + 1 < len && !(style[i] == '*' && style[i + 1] == '/'); ++i)
+				;
+			i = i + 2 < len ? i + 2 : len;
+			space = true;
+			continue;
+		}
+		
+		// whitespace is kept as a single space, unless it only separates a
+		// token from punctuation which cannot be mistaken for part of it. a
+		// space before a colon may be a descendant combinator.
+		char ch = style[i];
+		if (space && out_len && !strchr("{};,>", ch) && !(prev && strchr("{};,>:", prev)))
+			buf[out_len++] = ' ';
+		space = false;
+		
+		// the last declaration of a block needs no semicolon.
+		if (ch == '}' && prev == ';')
+			--out_len;
+		
+		// strings and escapes are copied as they are.
+		size_t begin = i++;
+		if (ch == '"' || ch == '\'')
+		{
+			for (; i < len && style[i] != ch; ++i)
+			{
+				if (style[i] == '\\')
+					++i;
+			}
+			i = i < len ? i + 1 : len;
+			prev = 0;
+		}
+		else if (ch == '\\')
+		{
+			i = i < len ? i + 1 : len;
+			prev = 0;
+		}
+		else
+			prev = strchr("{};,>:", ch) ? ch : 0;
+		
+		memcpy(&buf[out_len], &style[begin], i - begin);
+		out_len += i - begin;
+	}
+	
+	return out_len;
+}
+
+void
+cmfc_gzip_free(struct cmfc_gzip *gz)
+{
+	if (!gz)
+		return;
+	
+	free(gz->in);
+	free(gz->head);
+	free(gz->prev);
+	free(gz->syms);
+	free(gz->out);
+	free(gz);
+}
+
+struct cmfc_docdata *
+cmfc_docdata_new(char const *data, size_t len, char const *file, struct cmfc_error *err)
+{
+	struct cmfc_docdata *dd = calloc(1, sizeof(struct cmfc_docdata));
+	dd->ctx.markup_file = file;
+	
+	if (parse(&dd->ctx, NULL, data, len, file))
+	{
+		if (err)
+			*err = dd->ctx.err;
+		
+		cmfc_docdata_free(dd);
+		return NULL;
+	}
+	
+	return dd;
+}
+
+void
+cmfc_docdata_free(struct cmfc_docdata *dd)
+{
+	if (!dd)
+		return;
+	
+	doc_ctx_release(&dd->ctx);
+	free(dd);
+}
+
+int
+cmfc_error_format(char *buf, size_t size, struct cmfc_error const *err)
+{
+	if (!err->has_pos)
+		return snprintf(buf, size, "err: %s: %s!\n", err->msg, err->file);
+	
+	return snprintf(buf,
+	                size,
+	                "%s[%zu] err: %s!\n"
+	                "%zu...    %s\n",
+	                err->file,
+	                err->pos,
+	                err->msg,
+	                err->pos,
+	                err->line);
+}
+
+// continue the hash `h` with more data. words are mixed in with a multiply and
+// shift, 8 bytes at a time; any tail is mixed in byte by byte as in FNV-1a.
+uint64_t
+cmfc_hash(uint64_t h, void const *data, size_t n)
+{
+	unsigned char const *p = data;
+	
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8)
+	{
+		uint64_t w;
+		memcpy(&w, &p[i], 8);
+		h = (h ^ w) * 0x9e3779b97f4a7c15ull;
+		h ^= h >> 32;
+	}
+	
+	for (; i < n; ++i)
+	{
+		h ^= p[i];
+		h *= 0x100000001b3ull;
+	}
+	
+	return h;
+}
+
+void
+cmfc_pool_run(size_t njobs, int nworkers, void (*fn)(void *, size_t, int), void *arg)
+{
+	if (nworkers > njobs)
+		nworkers = njobs;
+	
+	// there is no need to involve threads for trivial cases.
+	if (nworkers <= 1)
+	{
+		for (size_t i = 0; i < njobs; ++i)
+			fn(arg, i, 0);
+		return;
+	}
+	
+	// initially spread jobs out evenly, workers rebalance by stealing.
+	struct pool pool =
+	{
+		.deques = calloc(nworkers, sizeof(struct pool_deque)),
+		.nworkers = nworkers,
+		.fn = fn,
+		.arg = arg,
+	};
+	
+	for (int i = 0; i < nworkers; ++i)
+	{
+		pthread_mutex_init(&pool.deques[i].lock, NULL);
+		pool.deques[i].head = njobs * i / nworkers;
+		pool.deques[i].tail = njobs * (i + 1) / nworkers;
+	}
+	
+	pthread_t *threads = calloc(nworkers, sizeof(pthread_t));
+	struct pool_worker_arg *args = calloc(nworkers, sizeof(struct pool_worker_arg));
+	for (int i = 0; i < nworkers; ++i)
+	{
+		args[i] = (struct pool_worker_arg)
+		{
+			.pool = &pool,
+			.id = i,
+		};
+		pthread_create(&threads[i], NULL, pool_worker, &args[i]);
+	}
+	
+	for (int i = 0; i < nworkers; ++i)
+		pthread_join(threads[i], NULL);
+	
+	for (int i = 0; i < nworkers; ++i)
+		pthread_mutex_destroy(&pool.deques[i].lock);
+	
+	free(args);
+	free(threads);
+	free(pool.deques);
+}
+
+char const *
+cmfc_version(void)
+{
+	return VERSION;
+}
+
+char const *
+cmfc_node_type_name(int type)
+{
+	return type >= 0 && type < CMFC_NODE_TYPES ? node_type_names[type] : NULL;
+}
+
+static void *
+arena_alloc(struct arena *a, size_t size)
+{
+	size = size ? ALIGN_UP(size, ARENA_ALIGN) : ARENA_ALIGN;
+	++a->nallocs;
+	
+	// large allocations get a dedicated block, so that the remaining space in
+	// the current block is not wasted.
+	if (size > ARENA_BLOCK_SIZE / 4)
+	{
+		struct arena_block *b = arena_block_new(size);
+		if (!b)
+			return NULL;
+		
+		b->used = size;
+		a->held += size;
+		if (a->head)
+		{
+			b->next = a->head->next;
+			a->head->next = b;
+		}
+		else
+			a->head = b;
+		
+		return (char *)b + ALIGN_UP(sizeof(struct arena_block), ARENA_ALIGN);
+	}
+	
+	if (!a->head || a->head->used + size > a->head->size)
+	{
+		struct arena_block *b = arena_block_new(ARENA_BLOCK_SIZE);
+		if (!b)
+			return NULL;
+		
+		b->next = a->head;
+		a->head = b;
+		a->held += ARENA_BLOCK_SIZE;
+	}
+	
+	void *p = (char *)a->head + ALIGN_UP(sizeof(struct arena_block), ARENA_ALIGN) + a->head->used;
+	a->head->used += size;
+	
+	return p;
+}
+
+static struct arena_block *
+arena_block_new(size_t size)
+{
+	struct arena_block *b = malloc(ALIGN_UP(sizeof(struct arena_block), ARENA_ALIGN) + size);
+	if (!b)
+		return NULL;
+	
+	*b = (struct arena_block)
+	{
+		.size = size,
+	};
+	
+	return b;
+}
+
+static int
+arena_class(size_t size)
+{
+	int class = 0;
+	while (((size_t)ARENA_MIN_CLASS << class) < size)
+		++class;
+	
+	return class;
+}
+
+static void *
+arena_realloc(struct arena *a, void *ptr, size_t old_size, size_t new_size)
+{
+	int old_class = ptr ? arena_class(old_size) : -1;
+	int new_class = arena_class(new_size);
+	if (old_class == new_class)
+		return ptr;
+	
+	void *new_ptr;
+	if (a->free_lists[new_class])
+	{
+		new_ptr = a->free_lists[new_class];
+		a->free_lists[new_class] = *(void **)new_ptr;
+	}
+	else
+	{
+		new_ptr = arena_alloc(a, (size_t)ARENA_MIN_CLASS << new_class);
+		if (!new_ptr)
+			return NULL;
+	}
+	
+	if (ptr)
+	{
+		memcpy(new_ptr, ptr, old_size < new_size ? old_size : new_size);
+		*(void **)ptr = a->free_lists[old_class];
+		a->free_lists[old_class] = ptr;
+	}
+	
+	return new_ptr;
+}
+
+static void
+arena_release(struct arena *a)
+{
+	struct arena_block *b = a->head;
+	while (b)
+	{
+		struct arena_block *next = b->next;
+		free(b);
+		b = next;
+	}
+	
+	*a = (struct arena)
+	{
+		.nallocs = a->nallocs,
+	};
+}
+
+static char *
+arena_strndup(struct arena *a, char const *s, size_t n)
+{
+	char *new_s = arena_alloc(a, n + 1);
+	if (!new_s)
+		return NULL;
+	
+	memcpy(new_s, s, n);
+	new_s[n] = 0;
+	
+	return new_s;
+}
+
+// validate a binary AST before it is loaded, returning why it is invalid, or
+// NULL. nodes must form the tree the parser would have produced, so that HTML
+// generation can trust them as it trusts parsed nodes: children in
+// breadth-first order, of the types their parents accept, with the strings
+// their types carry.
+static char const *
+ast_check(char const *blob, size_t len)
+{
+	// strings carried by, and the child type accepted by, each type of node.
+	// NT_ROOT children may be of any top-level type.
+	static unsigned char const nstrings[CMFC_NODE_TYPES] =
+	{
+		[NT_TITLE] = 1,
+		[NT_PARAGRAPH] = 1,
+		[NT_LIST_ITEM] = 1,
+		[NT_IMAGE] = 1,
+		[NT_BLOCKQUOTE] = 1,
+		[NT_TABLE_ITEM] = 1,
+		[NT_FOOTNOTE] = 2,
+		[NT_LONG_CODE] = 1,
+	};
+	static unsigned char const child_type[CMFC_NODE_TYPES] =
+	{
+		[NT_U_LIST] = NT_LIST_ITEM,
+		[NT_O_LIST] = NT_LIST_ITEM,
+		[NT_TABLE] = NT_TABLE_ROW,
+		[NT_TABLE_ROW] = NT_TABLE_ITEM,
+	};
+	
+	struct ast_header hdr;
+	if (len < sizeof(hdr) || !cmfc_is_ast(blob, len))
+		return "not a binary AST";
+	
+	memcpy(&hdr, blob, sizeof(hdr));
+	if (hdr.order != AST_ORDER || hdr.slot_size != sizeof(union ast_slot))
+		return "binary AST was written on an incompatible platform";
+	
+	if ((uintptr_t)blob % sizeof(uint64_t))
+		return "binary AST is misaligned";
+	
+	size_t nodes_off = ALIGN_UP(sizeof(struct ast_header), sizeof(uint64_t));
+	if (hdr.len != len
+	    || blob[len - 1]
+	    || len < nodes_off
+	    || hdr.nnodes < 1
+	    || hdr.nnodes > (len - nodes_off) / sizeof(union ast_slot))
+	{
+		return "binary AST is corrupt";
+	}
+	
+	size_t str_off = nodes_off + hdr.nnodes * sizeof(union ast_slot);
+	for (size_t f = 0; f < AST_DOC_FIELDS; ++f)
+	{
+		if (!ast_str_ok(hdr.doc_data[f], str_off, len))
+			return "binary AST is corrupt";
+	}
+	
+	if (hdr.raw_title > 1 || hdr.raw_subtitle > 1)
+		return "binary AST is corrupt";
+	
+	union ast_slot const *slots = (union ast_slot const *)&blob[nodes_off];
+	if (slots[0].ser.type != NT_ROOT)
+		return "binary AST is corrupt";
+	
+	size_t next_child = 1;
+	for (size_t i = 0; i < hdr.nnodes; ++i)
+	{
+		struct ast_node const *sn = &slots[i].ser;
+		if (sn->type >= CMFC_NODE_TYPES || sn->raw_text > 1)
+			return "binary AST is corrupt";
+		
+		// title levels are written out as a single digit.
+		if (sn->type == NT_TITLE && (sn->arg < 1 || sn->arg > 6))
+			return "binary AST is corrupt";
+		if (sn->type == NT_LIST_ITEM && (sn->arg < 0 || sn->arg > CMFC_MAX_LIST_DEPTH))
+			return "binary AST is corrupt";
+		
+		for (int s = 0; s < 2; ++s)
+		{
+			if ((s < nstrings[sn->type]) != (sn->data[s] != 0) || !ast_str_ok(sn->data[s], str_off, len))
+				return "binary AST is corrupt";
+		}
+		
+		if (!sn->nchildren)
+			continue;
+		
+		if (sn->children != nodes_off + next_child * sizeof(union ast_slot)
+		    || sn->nchildren > hdr.nnodes - next_child)
+		{
+			return "binary AST is corrupt";
+		}
+		
+		for (size_t c = next_child; c < next_child + sn->nchildren; ++c)
+		{
+			unsigned char type = slots[c].ser.type;
+			bool ok;
+			if (sn->type == NT_ROOT)
+				ok = type != NT_ROOT && type != NT_LIST_ITEM && type != NT_TABLE_ROW && type != NT_TABLE_ITEM;
+			else
+				ok = child_type[sn->type] && type == child_type[sn->type];
+			
+			if (!ok)
+				return "binary AST is corrupt";
+		}
+		
+		next_child += sn->nchildren;
+	}
+	
+	if (next_child != hdr.nnodes)
+		return "binary AST is corrupt";
+	
+	return NULL;
+}
+
+// strings lie after the nodes; the final null byte terminates any of them.
+static bool
+ast_str_ok(uint64_t off, size_t str_off, size_t len)
+{
+	return !off || (off >= str_off && off < len);
+}
+
+// the offset a string gets once appended after the strings ending at
+// `*str_off`, which is advanced past it.
+static uint64_t
+ast_str_take(char const *s, size_t *str_off)
+{
+	if (!s)
+		return 0;
+	
+	uint64_t off = *str_off;
+	*str_off += strlen(s) + 1;
+	
+	return off;
+}
+
+// serialize the document into `ctx->out` as a binary AST.
+static void
+ast_write(struct doc_ctx *ctx)
+{
+	// order the nodes breadth-first, so that the children of each node
+	// directly follow those of the node before it.
+	size_t nnodes = 1, cap = 64;
+	struct node const **order = malloc(cap * sizeof(struct node const *));
+	order[0] = &ctx->doc_root;
+	for (size_t i = 0; i < nnodes; ++i)
+	{
+		while (nnodes + order[i]->nchildren > cap)
+		{
+			cap *= 2;
+			order = reallocarray(order, cap, sizeof(struct node const *));
+		}
+		
+		for (size_t c = 0; c < order[i]->nchildren; ++c)
+			order[nnodes++] = &order[i]->children[c];
+	}
+	
+	size_t nodes_off = ALIGN_UP(sizeof(struct ast_header), sizeof(uint64_t));
+	size_t str_off = nodes_off + nnodes * sizeof(union ast_slot);
+	
+	struct ast_header hdr =
+	{
+		.order = AST_ORDER,
+		.slot_size = sizeof(union ast_slot),
+		.nnodes = nnodes,
+		.raw_title = ctx->doc_data.raw_title,
+		.raw_subtitle = ctx->doc_data.raw_subtitle,
+	};
+	memcpy(hdr.magic, AST_MAGIC, sizeof(hdr.magic));
+	
+	char **fields[AST_DOC_FIELDS];
+	doc_data_fields(&ctx->doc_data, fields);
+	for (size_t f = 0; f < AST_DOC_FIELDS; ++f)
+		hdr.doc_data[f] = ast_str_take(*fields[f], &str_off);
+	
+	// the header is written once the length is known.
+	static char const zeros[sizeof(struct ast_header) + sizeof(uint64_t)];
+	size_t begin = ctx->out.len;
+	out_append(&ctx->out, zeros, nodes_off);
+	
+	size_t next_child = 1;
+	for (size_t i = 0; i < nnodes; ++i)
+	{
+		// slots are zeroed first so that equal documents give equal blobs,
+		// padding included.
+		union ast_slot slot;
+		memset(&slot, 0, sizeof(slot));
+		slot.ser.data[0] = ast_str_take(order[i]->data[0], &str_off);
+		slot.ser.data[1] = ast_str_take(order[i]->data[1], &str_off);
+		slot.ser.children = order[i]->nchildren ? nodes_off + next_child * sizeof(union ast_slot) : 0;
+		slot.ser.nchildren = order[i]->nchildren;
+		slot.ser.arg = order[i]->arg;
+		slot.ser.type = order[i]->type;
+		slot.ser.raw_text = order[i]->raw_text;
+		next_child += order[i]->nchildren;
+		
+		out_append(&ctx->out, (char const *)&slot, sizeof(slot));
+	}
+	
+	// strings, in the order their offsets were taken.
+	for (size_t f = 0; f < AST_DOC_FIELDS; ++f)
+	{
+		if (*fields[f])
+			out_append(&ctx->out, *fields[f], strlen(*fields[f]) + 1);
+	}
+	
+	for (size_t i = 0; i < nnodes; ++i)
+	{
+		for (int s = 0; s < 2; ++s)
+		{
+			if (order[i]->data[s])
+				out_append(&ctx->out, order[i]->data[s], strlen(order[i]->data[s]) + 1);
+		}
+	}
+	OUT_LIT(&ctx->out, "\0");
+	
+	hdr.len = ctx->out.len - begin;
+	memcpy(&ctx->out.data[begin], &hdr, sizeof(hdr));
+	
+	free(order);
+}
+
+// find the first boundary out of `ends` at or after `i`, or the null
+// terminator. boundaries all begin with a newline, so this jumps from newline
+// to newline and only inspects the few bytes after each, rather than testing
+// every byte against every boundary.
+static size_t
+block_end(char const *data, size_t i, unsigned ends)
+{
+	for (;;)
+	{
+		i += strcspn(&data[i], "\n");
+		if (!data[i])
+			return i;
+		
+		char const *next = &data[i + 1];
+		if ((ends & BE_BLANK && next[0] == '\n')
+		    || (ends & BE_INDENT && !strncmp(next, "    ", 4))
+		    || (ends & BE_U_ITEM && next[0] == '*')
+		    || (ends & BE_O_ITEM && next[0] == '#')
+		    || (ends & BE_CODE_FENCE && !strncmp(next, "```", 3)))
+		{
+			return i;
+		}
+		
+		++i;
+	}
+}
+
+// determine which kind of node the block at `i` parses into, NT_ROOT meaning
+// it produces no node, i.e. a DOC directive or a blank line.
+static enum node_type
+block_type(char const *data, size_t i)
+{
+	if (!strncmp("DOC", &data[i], 3))
+		return NT_ROOT;
+	else if (data[i] == '=')
+		return NT_TITLE;
+	else if (data[i] == '*')
+		return NT_U_LIST;
+	else if (data[i] == '#')
+		return NT_O_LIST;
+	else if (!strncmp("      ", &data[i], 6))
+		return NT_BLOCKQUOTE;
+	else if (!strncmp("```\n", &data[i], 4))
+		return NT_LONG_CODE;
+	else if (!strncmp("---", &data[i], 3))
+		return NT_TABLE;
+	else if (!strncmp("!()", &data[i], 3))
+		return NT_IMAGE;
+	else if (!strncmp("[^", &data[i], 2))
+		return NT_FOOTNOTE;
+	else if (data[i] != '\n')
+		return NT_PARAGRAPH;
+	else
+		return NT_ROOT;
+}
+
+// build a document's output into `ctx->out`.
+static int
+doc_build(struct doc_ctx *ctx, char const *markup, size_t len, enum doc_format fmt)
+{
+	if (fmt == DF_HTML && !ctx->out.fixed)
+	{
+		// reserve roughly enough for the whole page up front.
+		ctx->out.cap = len + len / 4 + ctx->style_len + 4096;
+		ctx->out.data = malloc(ctx->out.cap);
+	}
+	
+	double t = stats_clock(ctx);
+	if (parse(ctx, &ctx->doc_root, markup, len, ctx->markup_file))
+		return 1;
+	
+	double parse_end = stats_clock(ctx);
+	if (doc_data_verify(ctx))
+		return 1;
+	
+	if (footnote_commit(ctx, markup) || footnote_check(ctx, markup))
+		return 1;
+	
+	double verify_end = stats_clock(ctx);
+	if (fmt == DF_AST_DUMP)
+		node_print(&ctx->out, &ctx->doc_root, 0);
+	else if (fmt == DF_AST_BLOB)
+		ast_write(ctx);
+	else if (gen_html(ctx))
+		return 1;
+	
+	if (ctx->stats)
+	{
+		ctx->stats->parse_secs += parse_end - t;
+		ctx->stats->verify_secs += verify_end - parse_end;
+		ctx->stats->gen_secs += stats_clock(ctx) - verify_end;
+		stats_count_nodes(ctx->stats, &ctx->doc_root);
+	}
+	
+	return out_limit_check(ctx);
+}
+
+// build a document's output into `ctx->out`, reusing the output of each block
+// unchanged since the previous compile, and record the output of each block
+// for the next one. the previous compile must have had the same options, as
+// whether titles have ids, say, is only known from those of the current one.
+static int
+doc_incremental(struct doc_ctx *ctx, char const *data, size_t len, struct cmfc_prev const *prev)
+{
+	double t = stats_clock(ctx);
+	struct block *blocks;
+	size_t nblocks;
+	if (parse_index(ctx, &blocks, &nblocks, data, len, ctx->markup_file))
+		return 1;
+	
+	double index_end = stats_clock(ctx);
+	if (doc_data_verify(ctx))
+	{
+		free(blocks);
+		return 1;
+	}
+	
+	double verify_end = stats_clock(ctx);
+	
+	struct frag_table ft;
+	frag_table_init(&ft, prev);
+	
+	ctx->out.cap = len + len / 4 + ctx->style_len + 4096;
+	ctx->out.data = malloc(ctx->out.cap);
+	
+	// only blocks without a previous fragment need to be parsed. blocks which
+	// may mention footnotes are parsed regardless, so that all footnotes of the
+	// document are checked, as are titles given ids, which depend on those of
+	// the titles before them.
+	struct cmfc_frag *frags = malloc(nblocks * sizeof(struct cmfc_frag));
+	ctx->frags = frags;
+	ctx->nfrags = nblocks;
+	struct cmfc_frag const **hits = malloc(nblocks * sizeof(struct cmfc_frag const *));
+	struct block *misses = malloc(nblocks * sizeof(struct block));
+	size_t nmisses = 0, miss_len = 0;
+	for (size_t b = 0; b < nblocks; ++b)
+	{
+		frags[b].key = frag_key(&blocks[b], data, len);
+		hits[b] = frag_find(&ft, frags[b].key);
+		if (hits[b] && footnote_in_block(data, &blocks[b]))
+			hits[b] = NULL;
+		if (hits[b] && ctx->heading_ids && blocks[b].type == NT_TITLE)
+			hits[b] = NULL;
+		if (!hits[b])
+		{
+			misses[nmisses++] = blocks[b];
+			miss_len += blocks[b].end - blocks[b].begin;
+		}
+	}
+	
+	struct node *nodes = arena_alloc(&ctx->arena, nmisses * sizeof(struct node));
+	int njobs = miss_len >= PARALLEL_PARSE_MIN ? ctx->parse_jobs : 1;
+	int rc = nodes ? parse_blocks(ctx, nodes, misses, nmisses, data, len, ctx->markup_file, njobs) : doc_oom(ctx);
+	if (!rc)
+		rc = footnote_commit(ctx, data) || footnote_check(ctx, data);
+	
+	double parse_end = stats_clock(ctx);
+	for (size_t m = 0; !rc && ctx->heading_ids && m < nmisses; ++m)
+	{
+		if (nodes[m].type == NT_TITLE && heading_add(&ctx->headings, &nodes[m]))
+			rc = doc_oom(ctx);
+	}
+	
+	if (!rc)
+	{
+		gen_html_head(ctx);
+		for (size_t b = 0, m = 0; b < nblocks; ++b)
+		{
+			frags[b].off = ctx->out.len;
+			if (hits[b])
+				out_append(&ctx->out, &prev->out[hits[b]->off], hits[b]->len);
+			else
+				gen_node_html(ctx, &nodes[m++]);
+			frags[b].len = ctx->out.len - frags[b].off;
+		}
+		gen_html_foot(ctx);
+		rc = out_limit_check(ctx);
+	}
+	
+	if (ctx->stats && !rc)
+	{
+		ctx->stats->parse_secs += index_end - t + parse_end - verify_end;
+		ctx->stats->verify_secs += verify_end - index_end;
+		ctx->stats->gen_secs += stats_clock(ctx) - parse_end;
+		
+		// only the blocks parsed again are counted.
+		++ctx->stats->nodes[NT_ROOT];
+		for (size_t m = 0; m < nmisses; ++m)
+			stats_count_nodes(ctx->stats, &nodes[m]);
+	}
+	
+	free(ft.slots);
+	free(misses);
+	free(hits);
+	free(blocks);
+	
+	return rc;
+}
+
+// compile a document block by block as it is read, writing out each block's
+// output and freeing it soon after. only the block being parsed and the
+// document data stay in memory, so memory use is bounded by the largest block
+// rather than the whole document.
+static int
+doc_stream(struct doc_ctx *ctx, cmfc_read_fn read, void *read_user, cmfc_write_fn write, void *write_user, bool dump_ast)
+{
+	int rc = CMFC_ERR;
+	
+	struct arena meta = {0};
+	struct stream_buf sb = {0};
+	bool head_done = false;
+	size_t out_total = 0;
+	double t;
+	
+	// errors in footnotes are only found once the markup they are in is gone.
+	ctx->fn_table.keep_lines = true;
+	
+	// the table of contents would precede titles not yet read.
+	if (ctx->toc && !dump_ast)
+	{
+		doc_err(ctx, "a table of contents cannot be generated when streaming");
+		goto done;
+	}
+	
+	if (dump_ast)
+		OUT_LIT(&ctx->out, "NT_ROOT: 0\n");
+	
+	for (;;)
+	{
+		if (sb.pos >= sb.len && sb.eof)
+			break;
+		
+		struct doc_data prev_doc_data = ctx->doc_data;
+		bool prev_raw_text = ctx->raw_text;
+		
+		// tentatively parse the next block. unless the input is exhausted, it
+		// is only known to be complete if enough input follows it for all of
+		// its boundaries to have been decided.
+		struct node node;
+		size_t i = sb.pos;
+		enum parse_status ps = PS_SKIP;
+		bool complete = false;
+		if (sb.pos < sb.len)
+		{
+			t = stats_clock(ctx);
+			ps = parse_any(ctx, &node, &i, sb.data, sb.len, ctx->markup_file);
+			if (ctx->stats)
+				ctx->stats->parse_secs += stats_clock(ctx) - t;
+			
+			// an error leaves no indication of how far the block extends, so
+			// it is only trusted once the input is exhausted.
+			complete = sb.eof || (ps != PS_ERR && i + STREAM_LOOKAHEAD <= sb.len);
+		}
+		
+		if (!complete)
+		{
+			// any error found in an incomplete block may be spurious.
+			ctx->doc_data = prev_doc_data;
+			ctx->raw_text = prev_raw_text;
+			ctx->err_set = false;
+			ctx->nfn_mentions = 0;
+			footnote_table_truncate(&ctx->fn_table, ctx->fn_table.ncommitted);
+			arena_release(&ctx->arena);
+			
+			ctx->pos_base += sb.pos;
+			if (stream_read(&sb, read, read_user))
+			{
+				rc = CMFC_ERR_IO;
+				goto done;
+			}
+			
+			continue;
+		}
+		
+		if (ps == PS_ERR)
+			goto done;
+		
+		if (footnote_commit(ctx, sb.data))
+			goto done;
+		
+		size_t begin = sb.pos;
+		sb.pos = i;
+		
+		if (ps == PS_SKIP)
+		{
+			// DOC directives must outlive the block they come from. the head is
+			// written before any content, so after that only the footer may
+			// still change.
+			char **fields[] =
+			{
+				&ctx->doc_data.title,
+				&ctx->doc_data.subtitle,
+				&ctx->doc_data.author,
+				&ctx->doc_data.created,
+				&ctx->doc_data.revised,
+				&ctx->doc_data.favicon,
+				&ctx->doc_data.license,
+			};
+			char *prev_fields[] =
+			{
+				prev_doc_data.title,
+				prev_doc_data.subtitle,
+				prev_doc_data.author,
+				prev_doc_data.created,
+				prev_doc_data.revised,
+				prev_doc_data.favicon,
+				prev_doc_data.license,
+			};
+			
+			for (size_t f = 0; f < sizeof(fields) / sizeof(fields[0]); ++f)
+			{
+				if (*fields[f] == prev_fields[f])
+					continue;
+				
+				if (head_done && fields[f] != &ctx->doc_data.license)
+				{
+					prog_err(ctx, ctx->markup_file, sb.data, begin, "DOC directive must precede content when streaming");
+					goto done;
+				}
+				
+				*fields[f] = arena_strndup(&meta, *fields[f], strlen(*fields[f]));
+				if (!*fields[f])
+				{
+					doc_oom(ctx);
+					goto done;
+				}
+			}
+			
+			arena_release(&ctx->arena);
+			continue;
+		}
+		
+		if (!head_done)
+		{
+			t = stats_clock(ctx);
+			if (doc_data_verify(ctx))
+				goto done;
+			if (ctx->stats)
+				ctx->stats->verify_secs += stats_clock(ctx) - t;
+			
+			if (!dump_ast)
+				gen_html_head(ctx);
+			head_done = true;
+		}
+		
+		t = stats_clock(ctx);
+		if (dump_ast)
+			node_print(&ctx->out, &node, 1);
+		else
+		{
+			if (ctx->heading_ids && node.type == NT_TITLE && heading_add(&ctx->headings, &node))
+			{
+				doc_oom(ctx);
+				goto done;
+			}
+			gen_node_html(ctx, &node);
+		}
+		
+		if (ctx->stats)
+		{
+			ctx->stats->gen_secs += stats_clock(ctx) - t;
+			stats_count_nodes(ctx->stats, &node);
+			stats_sample_mem(ctx, sb.cap + meta.held);
+		}
+		
+		arena_release(&ctx->arena);
+		
+		if (out_limit_check(ctx))
+			goto done;
+		
+		if (ctx->out.len >= STREAM_FLUSH)
+		{
+			out_total += ctx->out.len;
+			if (out_flush(&ctx->out, write, write_user))
+			{
+				rc = CMFC_ERR_IO;
+				goto done;
+			}
+		}
+	}
+	
+	if (!head_done)
+	{
+		t = stats_clock(ctx);
+		if (doc_data_verify(ctx))
+			goto done;
+		if (ctx->stats)
+			ctx->stats->verify_secs += stats_clock(ctx) - t;
+		
+		if (!dump_ast)
+			gen_html_head(ctx);
+	}
+	
+	if (footnote_check(ctx, NULL))
+		goto done;
+	
+	if (!dump_ast)
+		gen_html_foot(ctx);
+	
+	if (out_limit_check(ctx))
+		goto done;
+	
+	out_total += ctx->out.len;
+	if (out_flush(&ctx->out, write, write_user))
+	{
+		rc = CMFC_ERR_IO;
+		goto done;
+	}
+	
+	rc = CMFC_OK;
+	
+done:
+	if (ctx->stats)
+	{
+		++ctx->stats->nodes[NT_ROOT];
+		ctx->stats->allocs += meta.nallocs;
+		stats_finish(ctx, ctx->pos_base + sb.len, out_total);
+	}
+	
+	free(sb.data);
+	arena_release(&meta);
+	
+	return rc;
+}
+
+// set up a context to compile a document with the given options.
+static void
+doc_ctx_init(struct doc_ctx *ctx, struct cmfc_opts const *opts)
+{
+	*ctx = (struct doc_ctx)
+	{
+		.markup_file = opts->file ? opts->file : "markup",
+		.style = opts->style,
+		.style_len = opts->style_len,
+		.style_href = opts->style_href,
+		.parse_jobs = opts->jobs > 1 ? opts->jobs : 1,
+		.stats = opts->stats,
+		.fn_renumber = opts->renumber_footnotes,
+		.heading_ids = opts->heading_ids || opts->toc,
+		.toc = opts->toc,
+		.word = opts->word,
+		.word_user = opts->word_user,
+		.out.limit = opts->max_out,
+		.out.minify = opts->minify && !opts->dump_ast,
+	};
+	
+	// footnotes are numbered as they are parsed, which must be done in order.
+	if (ctx->fn_renumber)
+		ctx->parse_jobs = 1;
+	
+	if (ctx->stats)
+		*ctx->stats = (struct cmfc_stats){0};
+	
+	// every document starts from the state left by the docdata.
+	if (opts->docdata)
+	{
+		ctx->doc_data = opts->docdata->ctx.doc_data;
+		ctx->raw_text = opts->docdata->ctx.raw_text;
+	}
+}
+
+static void
+doc_ctx_release(struct doc_ctx *ctx)
+{
+	for (int i = 0; i < ctx->nworkers; ++i)
+		doc_ctx_release(&ctx->workers[i]);
+	free(ctx->workers);
+	
+	free(ctx->out.data);
+	free(ctx->scratch);
+	free(ctx->cells);
+	free(ctx->frags);
+	free(ctx->fn_mentions);
+	footnote_table_release(&ctx->fn_table);
+	heading_table_release(&ctx->headings);
+	arena_release(&ctx->arena);
+}
+
+// pointers to the fields of the document data, in the order binary ASTs store
+// them.
+static void
+doc_data_fields(struct doc_data *dd, char **fields[AST_DOC_FIELDS])
+{
+	fields[0] = &dd->title;
+	fields[1] = &dd->subtitle;
+	fields[2] = &dd->author;
+	fields[3] = &dd->created;
+	fields[4] = &dd->revised;
+	fields[5] = &dd->license;
+	fields[6] = &dd->favicon;
+}
+
+static int
+doc_data_verify(struct doc_ctx *ctx)
+{
+	// check for presence of all necessary data.
+	{
+		if (!ctx->doc_data.title)
+		{
+			doc_err(ctx, "document missing a title");
+			return 1;
+		}
+		
+		if (ctx->doc_data.revised && !ctx->doc_data.created)
+		{
+			doc_err(ctx, "document missing a creation date, only revision provided");
+			return 1;
+		}
+	}
+	
+	return 0;
+}
+
+// record an error concerning the document as a whole.
+static void
+doc_err(struct doc_ctx *ctx, char const *msg)
+{
+	if (ctx->err_set)
+		return;
+	
+	ctx->err_set = true;
+	ctx->err = (struct cmfc_error)
+	{
+		.file = ctx->markup_file,
+	};
+	snprintf(ctx->err.msg, sizeof(ctx->err.msg), "%s", msg);
+}
+
+// fail a compile for want of memory.
+static enum parse_status
+doc_oom(struct doc_ctx *ctx)
+{
+	doc_err(ctx, "out of memory");
+	return PS_ERR;
+}
+
+static char const *
+entity_char(char ch)
+{
+	switch (ch)
+	{
+	case '<':
+		return "&lt;";
+	case '>':
+		return "&gt;";
+	case '&':
+		return "&amp;";
+	case '"':
+		return "&quot;";
+	case '\'':
+		return "&apos;";
+	
+	default:
+		return NULL;
+	}
+}
+
+// check that every footnote referenced is defined exactly once, reporting the
+// first mention in the document which is not. `data` is the markup, unless
+// the lines of mentions were kept.
+static int
+footnote_check(struct doc_ctx *ctx, char const *data)
+{
+	struct footnote_table const *ft = &ctx->fn_table;
+	
+	size_t pos = ft->dup ? ft->dup_pos : SIZE_MAX;
+	char const *line = ft->dup_line;
+	char const *msg = "footnote defined more than once";
+	for (size_t e = 0; e < ft->nentries; ++e)
+	{
+		struct footnote_entry const *fe = &ft->entries[e];
+		if (fe->referenced && !fe->defined && fe->ref_pos < pos)
+		{
+			pos = fe->ref_pos;
+			line = fe->ref_line;
+			msg = "reference to undefined footnote";
+		}
+	}
+	
+	if (pos == SIZE_MAX)
+		return 0;
+	
+	if (!ctx->err_set)
+	{
+		ctx->err_set = true;
+		ctx->err = (struct cmfc_error)
+		{
+			.file = ctx->markup_file,
+			.has_pos = true,
+			.pos = pos,
+		};
+		snprintf(ctx->err.msg, sizeof(ctx->err.msg), "%s", msg);
+		if (ft->keep_lines)
+			snprintf(ctx->err.line, sizeof(ctx->err.line), "%s", line);
+		else
+			single_line(ctx->err.line, sizeof(ctx->err.line), data, pos);
+	}
+	
+	return 1;
+}
+
+// enter the footnotes mentioned in the blocks just parsed from `data` into the
+// table.
+static int
+footnote_commit(struct doc_ctx *ctx, char const *data)
+{
+	struct footnote_table *ft = &ctx->fn_table;
+	
+	// blocks parsed in parallel are not mentioned in order.
+	for (size_t m = 1; m < ctx->nfn_mentions; ++m)
+	{
+		if (ctx->fn_mentions[m].pos < ctx->fn_mentions[m - 1].pos)
+		{
+			qsort(ctx->fn_mentions, ctx->nfn_mentions, sizeof(struct footnote_mention), footnote_mention_cmp);
+			break;
+		}
+	}
+	
+	for (size_t m = 0; m < ctx->nfn_mentions; ++m)
+	{
+		struct footnote_mention const *fm = &ctx->fn_mentions[m];
+		size_t e = footnote_intern(ft, fm->name, strlen(fm->name));
+		if (e == SIZE_MAX)
+			return doc_oom(ctx);
+		
+		struct footnote_entry *fe = &ft->entries[e];
+		
+		// titles are given ids once all footnotes are known, except when
+		// streaming, where a title before a footnote may have its id.
+		int reserved = ctx->heading_ids ? heading_reserve(&ctx->headings, fe->name) : 0;
+		if (reserved > 0)
+			return doc_oom(ctx);
+		
+		if (reserved)
+		{
+			if (!ctx->err_set)
+			{
+				ctx->err_set = true;
+				ctx->err = (struct cmfc_error)
+				{
+					.file = ctx->markup_file,
+					.has_pos = true,
+					.pos = fm->pos,
+				};
+				snprintf(ctx->err.msg, sizeof(ctx->err.msg), "footnote has the id of an earlier title");
+				single_line(ctx->err.line, sizeof(ctx->err.line), data, fm->pos - ctx->pos_base);
+			}
+			
+			return 1;
+		}
+		
+		char line[sizeof(ctx->err.line)];
+		if (fm->def && fe->defined && !ft->dup)
+		{
+			ft->dup = true;
+			ft->dup_pos = fm->pos;
+			if (ft->keep_lines)
+			{
+				single_line(line, sizeof(line), data, fm->pos - ctx->pos_base);
+				ft->dup_line = arena_strndup(&ft->arena, line, strlen(line));
+				if (!ft->dup_line)
+					return doc_oom(ctx);
+			}
+		}
+		else if (!fm->def && !fe->defined && !fe->referenced)
+		{
+			fe->ref_pos = fm->pos;
+			if (ft->keep_lines)
+			{
+				single_line(line, sizeof(line), data, fm->pos - ctx->pos_base);
+				fe->ref_line = arena_strndup(&ft->arena, line, strlen(line));
+				if (!fe->ref_line)
+					return doc_oom(ctx);
+			}
+		}
+		
+		fe->defined |= fm->def;
+		fe->referenced |= !fm->def;
+	}
+	
+	ctx->nfn_mentions = 0;
+	ft->ncommitted = ft->nentries;
+	
+	return 0;
+}
+
+// whether a block may mention a footnote, i.e. contains `[^` anywhere.
+static bool
+footnote_in_block(char const *data, struct block const *b)
+{
+	for (char const *p = &data[b->begin]; (p = memchr(p, '[', &data[b->end] - p)); ++p)
+	{
+		if (p + 1 < &data[b->end] && p[1] == '^')
+			return true;
+	}
+	
+	return false;
+}
+
+// find a footnote in the table by name, adding it if it is not there yet.
+// returns the index of its entry, or SIZE_MAX if out of memory.
+static size_t
+footnote_intern(struct footnote_table *ft, char const *name, size_t len)
+{
+	uint64_t hash = cmfc_hash(CMFC_HASH_INIT, name, len);
+	
+	// the table is kept at most half full.
+	if (2 * (ft->nentries + 1) > ft->cap)
+	{
+		ft->cap = ft->cap ? 2 * ft->cap : 16;
+		free(ft->slots);
+		ft->slots = calloc(ft->cap, sizeof(size_t));
+		for (size_t e = 0; e < ft->nentries; ++e)
+		{
+			size_t i = hash_slot(ft->entries[e].hash, ft->cap);
+			while (ft->slots[i])
+				i = (i + 1) & (ft->cap - 1);
+			ft->slots[i] = e + 1;
+		}
+	}
+	
+	size_t mask = ft->cap - 1, i;
+	for (i = hash_slot(hash, ft->cap); ft->slots[i]; i = (i + 1) & mask)
+	{
+		struct footnote_entry const *fe = &ft->entries[ft->slots[i] - 1];
+		if (fe->hash == hash && !strncmp(fe->name, name, len) && !fe->name[len])
+			return ft->slots[i] - 1;
+	}
+	
+	if (ft->nentries >= ft->entries_cap)
+	{
+		ft->entries_cap = ft->entries_cap ? 2 * ft->entries_cap : 16;
+		ft->entries = reallocarray(ft->entries, ft->entries_cap, sizeof(struct footnote_entry));
+	}
+	
+	char *name_copy = arena_strndup(&ft->arena, name, len);
+	if (!name_copy)
+		return SIZE_MAX;
+	
+	ft->entries[ft->nentries] = (struct footnote_entry)
+	{
+		.name = name_copy,
+		.hash = hash,
+	};
+	ft->slots[i] = ++ft->nentries;
+	
+	return ft->nentries - 1;
+}
+
+// record a mention of a footnote at `pos` in the markup, returning its number
+// if footnotes are renumbered, or 0. running out of memory fails the compile.
+static size_t
+footnote_mention(struct doc_ctx *ctx, char const *name, size_t len, size_t pos, bool def)
+{
+	if (ctx->nfn_mentions >= ctx->fn_mentions_cap)
+	{
+		ctx->fn_mentions_cap = ctx->fn_mentions_cap ? 2 * ctx->fn_mentions_cap : 16;
+		ctx->fn_mentions = reallocarray(ctx->fn_mentions, ctx->fn_mentions_cap, sizeof(struct footnote_mention));
+	}
+	
+	char *name_copy = arena_strndup(&ctx->arena, name, len);
+	if (!name_copy)
+	{
+		doc_oom(ctx);
+		return 0;
+	}
+	
+	ctx->fn_mentions[ctx->nfn_mentions++] = (struct footnote_mention)
+	{
+		.name = name_copy,
+		.pos = ctx->pos_base + pos,
+		.def = def,
+	};
+	
+	// renumbered documents are parsed in order, so the number of a footnote
+	// is known as soon as it is first mentioned.
+	if (!ctx->fn_renumber)
+		return 0;
+	
+	size_t e = footnote_intern(&ctx->fn_table, name, len);
+	if (e == SIZE_MAX)
+	{
+		doc_oom(ctx);
+		return 0;
+	}
+	
+	return e + 1;
+}
+
+static int
+footnote_mention_cmp(void const *a, void const *b)
+{
+	struct footnote_mention const *fm_a = a, *fm_b = b;
+	return (fm_a->pos > fm_b->pos) - (fm_a->pos < fm_b->pos);
+}
+
+static void
+footnote_table_release(struct footnote_table *ft)
+{
+	free(ft->entries);
+	free(ft->slots);
+	arena_release(&ft->arena);
+}
+
+// remove the entries added since the table had `nentries` entries. with linear
+// probing, entries may be removed from the table in reverse order of insertion
+// without breaking the probe sequences of those remaining.
+static void
+footnote_table_truncate(struct footnote_table *ft, size_t nentries)
+{
+	size_t mask = ft->cap - 1;
+	for (; ft->nentries > nentries; --ft->nentries)
+	{
+		size_t i = hash_slot(ft->entries[ft->nentries - 1].hash, ft->cap);
+		while (ft->slots[i] != ft->nentries)
+			i = (i + 1) & mask;
+		ft->slots[i] = 0;
+	}
+}
+
+static struct cmfc_frag const *
+frag_find(struct frag_table const *ft, uint64_t key)
+{
+	if (!ft->cap)
+		return NULL;
+	
+	size_t mask = ft->cap - 1;
+	for (size_t i = key & mask; ft->slots[i]; i = (i + 1) & mask)
+	{
+		struct cmfc_frag const *f = &ft->frags[ft->slots[i] - 1];
+		if (f->key == key)
+			return f;
+	}
+	
+	return NULL;
+}
+
+// the bytes just past a block are part of its key, as the parser looks ahead
+// that far to decide how the block ends.
+static uint64_t
+frag_key(struct block const *b, char const *data, size_t len)
+{
+	size_t end = len - b->end > STREAM_LOOKAHEAD ? b->end + STREAM_LOOKAHEAD : len;
+	size_t block_len = b->end - b->begin;
+	
+	uint64_t h = cmfc_hash(CMFC_HASH_INIT, &b->raw_text, sizeof(b->raw_text));
+	h = cmfc_hash(h, &b->type, sizeof(b->type));
+	h = cmfc_hash(h, &block_len, sizeof(block_len));
+	
+	return cmfc_hash(h, &data[b->begin], end - b->begin);
+}
+
+// a previous compile whose fragments do not all lie within its output is
+// ignored, as if there was none.
+static void
+frag_table_init(struct frag_table *ft, struct cmfc_prev const *prev)
+{
+	*ft = (struct frag_table){0};
+	
+	if (!prev)
+		return;
+	
+	for (size_t f = 0; f < prev->nfrags; ++f)
+	{
+		if (prev->frags[f].off > prev->out_len || prev->frags[f].len > prev->out_len - prev->frags[f].off)
+			return;
+	}
+	
+	ft->frags = prev->frags;
+	ft->cap = 16;
+	while (ft->cap < 2 * prev->nfrags)
+		ft->cap *= 2;
+	ft->slots = calloc(ft->cap, sizeof(size_t));
+	
+	// blocks with equal keys have equal output, only one of them is kept.
+	size_t mask = ft->cap - 1;
+	for (size_t f = 0; f < prev->nfrags; ++f)
+	{
+		size_t i = prev->frags[f].key & mask;
+		while (ft->slots[i] && prev->frags[ft->slots[i] - 1].key != prev->frags[f].key)
+			i = (i + 1) & mask;
+		if (!ft->slots[i])
+			ft->slots[i] = f + 1;
+	}
+}
+
+static int
+gen_html(struct doc_ctx *ctx)
+{
+	if (ctx->heading_ids)
+	{
+		// rendered ASTs have no footnote table, so the ids of their footnotes
+		// are taken from its nodes.
+		for (size_t i = 0; i < ctx->doc_root.nchildren; ++i)
+		{
+			struct node const *node = &ctx->doc_root.children[i];
+			if (node->type == NT_FOOTNOTE && heading_reserve(&ctx->headings, node->data[0]) > 0)
+				return doc_oom(ctx);
+		}
+		
+		for (size_t i = 0; i < ctx->doc_root.nchildren; ++i)
+		{
+			struct node const *node = &ctx->doc_root.children[i];
+			if (node->type == NT_TITLE && heading_add(&ctx->headings, node))
+				return doc_oom(ctx);
+		}
+	}
+	
+	gen_html_head(ctx);
+	
+	for (size_t i = 0; i < ctx->doc_root.nchildren; ++i)
+		gen_node_html(ctx, &ctx->doc_root.children[i]);
+	
+	gen_html_foot(ctx);
+	
+	return 0;
+}
+
+static void
+gen_html_foot(struct doc_ctx *ctx)
+{
+	struct out_buf *ob = &ctx->out;
+	
+	// write out postamble, footer document data.
+	{
+		if (ctx->doc_data.license)
+		{
+			OUT_LIT(ob, "<div class=\"doc-license\">");
+			out_str(ob, ctx->doc_data.license);
+			OUT_LIT(ob, "</div>");
+		}
+		
+		OUT_LIT(ob,
+		        "</body>\n"
+		        "</html>\n");
+	}
+}
+
+static void
+gen_html_head(struct doc_ctx *ctx)
+{
+	struct out_buf *ob = &ctx->out;
+	
+	if (ctx->word)
+	{
+		text_words(ctx, ctx->doc_data.title, ctx->doc_data.raw_title);
+		if (ctx->doc_data.subtitle)
+			text_words(ctx, ctx->doc_data.subtitle, ctx->doc_data.raw_subtitle);
+	}
+	
+	// write out preamble, head, header document data.
+	{
+		OUT_LIT(ob,
+		        "<!DOCTYPE html>\n"
+		        "<html>\n"
+		        "<head>\n"
+		        "<meta charset=\"UTF-8\">\n"
+		        "<title>");
+		out_str(ob, ctx->doc_data.title);
+		OUT_LIT(ob, "</title>\n");
+		
+		if (ctx->style)
+		{
+			OUT_LIT(ob, "<style>");
+			out_append(ob, ctx->style, ctx->style_len);
+			OUT_LIT(ob, "</style>\n");
+		}
+		
+		if (ctx->style_href)
+		{
+			OUT_LIT(ob, "<link rel=\"stylesheet\" href=\"");
+			out_str(ob, ctx->style_href);
+			OUT_LIT(ob, "\">\n");
+		}
+		
+		if (ctx->doc_data.favicon)
+		{
+			OUT_LIT(ob, "<link rel=\"icon\" type=\"image/x-icon\" href=\"");
+			out_str(ob, ctx->doc_data.favicon);
+			OUT_LIT(ob, "\">\n");
+		}
+		
+		// write out author.
+		if (ctx->doc_data.author)
+		{
+			OUT_LIT(ob, "<div class=\"doc-author\">");
+			out_str(ob, ctx->doc_data.author);
+			OUT_LIT(ob, "</div>\n");
+		}
+		
+		// write out creation / revision date.
+		{
+			if (ctx->doc_data.created)
+			{
+				OUT_LIT(ob, "<div class=\"doc-date\">");
+				out_str(ob, ctx->doc_data.created);
+			}
+			if (ctx->doc_data.revised)
+			{
+				OUT_LIT(ob, " (rev. ");
+				out_str(ob, ctx->doc_data.revised);
+				OUT_LIT(ob, ")");
+			}
+			if (ctx->doc_data.created)
+				OUT_LIT(ob, "</div>\n");
+		}
+		
+		OUT_LIT(ob, "<div class=\"doc-title\">");
+		out_str(ob, ctx->doc_data.title);
+		OUT_LIT(ob, "</div>\n");
+		
+		if (ctx->doc_data.subtitle)
+		{
+			OUT_LIT(ob, "<div class=\"doc-subtitle\">");
+			out_str(ob, ctx->doc_data.subtitle);
+			OUT_LIT(ob, "</div>\n");
+		}
+		
+		OUT_LIT(ob,
+		        "</head>\n"
+		        "<body>\n");
+	}
+	
+	if (ctx->toc)
+		gen_toc_html(ctx);
+}
+
+static void
+gen_blockquote_html(struct doc_ctx *ctx, struct node const *node)
+{
+	OUT_LIT(&ctx->out, "<blockquote>");
+	out_str(&ctx->out, node->data[0]);
+	OUT_LIT(&ctx->out, "</blockquote>\n");
+}
+
+static void
+gen_footnote_html(struct doc_ctx *ctx, struct node const *node)
+{
+	OUT_LIT(&ctx->out, "<div class=\"footnote\" id=\"");
+	out_str(&ctx->out, node->data[0]);
+	OUT_LIT(&ctx->out, "\">");
+	out_str(&ctx->out, node->data[1]);
+	OUT_LIT(&ctx->out, "</div>\n");
+}
+
+static void
+gen_image_html(struct doc_ctx *ctx, struct node const *node)
+{
+	OUT_LIT(&ctx->out, "<img src=\"");
+	out_str(&ctx->out, node->data[0]);
+	OUT_LIT(&ctx->out, "\">");
+	
+	// images are inline, so the newline after one renders as a space between
+	// it and a following image, which minifying must keep.
+	out_append(&ctx->out, ctx->out.minify ? " " : "\n", 1);
+}
+
+static void
+gen_long_code_html(struct doc_ctx *ctx, struct node const *node)
+{
+	OUT_LIT(&ctx->out, "<div class=\"long-code\">");
+	out_str(&ctx->out, node->data[0]);
+	OUT_LIT(&ctx->out, "</div>\n");
+}
+
+static void
+gen_node_html(struct doc_ctx *ctx, struct node const *node)
+{
+	if (ctx->word)
+		node_words(ctx, node, node->raw_text);
+	
+	switch (node->type)
+	{
+	case NT_TITLE:
+		gen_title_html(ctx, node);
+		break;
+	case NT_PARAGRAPH:
+		gen_paragraph_html(ctx, node);
+		break;
+	case NT_U_LIST:
+		gen_u_list_html(ctx, node);
+		break;
+	case NT_O_LIST:
+		gen_o_list_html(ctx, node);
+		break;
+	case NT_IMAGE:
+		gen_image_html(ctx, node);
+		break;
+	case NT_BLOCKQUOTE:
+		gen_blockquote_html(ctx, node);
+		break;
+	case NT_TABLE:
+		gen_table_html(ctx, node);
+		break;
+	case NT_FOOTNOTE:
+		gen_footnote_html(ctx, node);
+		break;
+	case NT_LONG_CODE:
+		gen_long_code_html(ctx, node);
+		break;
+	}
+}
+
+static void
+gen_o_list_html(struct doc_ctx *ctx, struct node const *node)
+{
+	int cur_depth = 0;
+	for (size_t i = 0; i < node->nchildren; ++i)
+	{
+		int dd = node->children[i].arg - cur_depth;
+		while (dd > 0)
+		{
+			OUT_LIT(&ctx->out, "<ol>\n");
+			--dd;
+		}
+		while (dd < 0)
+		{
+			OUT_LIT(&ctx->out, "</ol>\n");
+			++dd;
+		}
+		
+		OUT_LIT(&ctx->out, "<li>");
+		out_str(&ctx->out, node->children[i].data[0]);
+		OUT_LIT(&ctx->out, "</li>\n");
+		
+		cur_depth = node->children[i].arg;
+	}
+	
+	while (cur_depth > 0)
+	{
+		OUT_LIT(&ctx->out, "</ol>\n");
+		--cur_depth;
+	}
+}
+
+static void
+gen_paragraph_html(struct doc_ctx *ctx, struct node const *node)
+{
+	OUT_LIT(&ctx->out, "<p>");
+	out_str(&ctx->out, node->data[0]);
+	OUT_LIT(&ctx->out, "</p>\n");
+}
+
+static void
+gen_table_html(struct doc_ctx *ctx, struct node const *node)
+{
+	OUT_LIT(&ctx->out, "<table>\n");
+	for (size_t row = 0; row < node->nchildren; ++row)
+	{
+		OUT_LIT(&ctx->out, "<tr>\n");
+		for (size_t col = 0; col < node->children[row].nchildren; ++col)
+		{
+			OUT_LIT(&ctx->out, "<td>");
+			out_str(&ctx->out, node->children[row].children[col].data[0]);
+			OUT_LIT(&ctx->out, "</td>\n");
+		}
+		OUT_LIT(&ctx->out, "</tr>\n");
+	}
+	OUT_LIT(&ctx->out, "</table>\n");
+}
+
+static void
+gen_title_html(struct doc_ctx *ctx, struct node const *node)
+{
+	// title sizes are validated to be single digits during parse.
+	char hsize = '0' + node->arg;
+	
+	OUT_LIT(&ctx->out, "<h");
+	out_append(&ctx->out, &hsize, 1);
+	if (ctx->heading_ids)
+	{
+		OUT_LIT(&ctx->out, " id=\"");
+		while (!ctx->headings.headings[ctx->headings.next].level)
+			++ctx->headings.next;
+		out_str(&ctx->out, ctx->headings.headings[ctx->headings.next++].id);
+		OUT_LIT(&ctx->out, "\"");
+	}
+	
+	OUT_LIT(&ctx->out, ">");
+	out_str(&ctx->out, node->data[0]);
+	OUT_LIT(&ctx->out, "</h");
+	out_append(&ctx->out, &hsize, 1);
+	OUT_LIT(&ctx->out, ">\n");
+}
+
+// write out a list of links to the titles, nested by their levels. a title is
+// nested under the last one of a lower level, if any, alongside the titles
+// nested there before it.
+static void
+gen_toc_html(struct doc_ctx *ctx)
+{
+	struct out_buf *ob = &ctx->out;
+	if (ctx->headings.nheadings == ctx->headings.nfootnotes)
+		return;
+	
+	OUT_LIT(ob, "<nav class=\"toc\">\n");
+	
+	// levels of the titles in each list open, from the outermost.
+	int levels[7];
+	int depth = 0;
+	for (size_t h = 0; h < ctx->headings.nheadings; ++h)
+	{
+		struct heading const *hd = &ctx->headings.headings[h];
+		if (!hd->level)
+			continue;
+		
+		while (depth > 1 && hd->level <= levels[depth - 2])
+		{
+			OUT_LIT(ob, "</li>\n</ul>\n");
+			--depth;
+		}
+		
+		if (!depth || hd->level > levels[depth - 1])
+		{
+			if (depth)
+				OUT_LIT(ob, "\n");
+			OUT_LIT(ob, "<ul>\n");
+			levels[depth++] = hd->level;
+		}
+		else
+		{
+			OUT_LIT(ob, "</li>\n");
+			levels[depth - 1] = hd->level;
+		}
+		
+		// links may not be nested, so the markup of titles is left out.
+		OUT_LIT(ob, "<li><a href=\"#");
+		out_str(ob, hd->id);
+		OUT_LIT(ob, "\">");
+		for (char const *p = hd->text; *p;)
+		{
+			size_t n = strcspn(p, "<");
+			out_append(ob, p, n);
+			p += n;
+			if (*p)
+				p = strchr(p, '>') ? strchr(p, '>') + 1 : p + strlen(p);
+		}
+		OUT_LIT(ob, "</a>");
+	}
+	
+	for (; depth; --depth)
+		OUT_LIT(ob, "</li>\n</ul>\n");
+	
+	OUT_LIT(ob, "</nav>\n");
+}
+
+static void
+gen_u_list_html(struct doc_ctx *ctx, struct node const *node)
+{
+	int cur_depth = 0;
+	for (size_t i = 0; i < node->nchildren; ++i)
+	{
+		int dd = node->children[i].arg - cur_depth;
+		while (dd > 0)
+		{
+			OUT_LIT(&ctx->out, "<ul>\n");
+			--dd;
+		}
+		while (dd < 0)
+		{
+			OUT_LIT(&ctx->out, "</ul>\n");
+			++dd;
+		}
+		
+		OUT_LIT(&ctx->out, "<li>");
+		out_str(&ctx->out, node->children[i].data[0]);
+		OUT_LIT(&ctx->out, "</li>\n");
+		
+		cur_depth = node->children[i].arg;
+	}
+	
+	while (cur_depth > 0)
+	{
+		OUT_LIT(&ctx->out, "</ul>\n");
+		--cur_depth;
+	}
+}
+
+// compress the buffered input as a dynamic Huffman deflate block, pass the
+// compressed data on, then keep the end of the input as history for the next
+// block.
+static int
+gz_block(struct cmfc_gzip *gz, bool final)
+{
+	// find matches, lazily: a match is not taken if the next position begins
+	// a longer one.
+	gz->nsyms = 0;
+	size_t i = gz->in_pos;
+	struct gz_match cur = gz_find(gz, i);
+	while (i < gz->in_len)
+	{
+		gz_insert(gz, i);
+		if (cur.len >= GZ_MIN_MATCH && cur.len < GZ_LAZY_MAX && i + 1 < gz->in_len)
+		{
+			struct gz_match next = gz_find(gz, i + 1);
+			if (next.len > cur.len)
+			{
+				gz->syms[gz->nsyms++] = (struct gz_sym){.litlen = gz->in[i]};
+				++i;
+				cur = next;
+				continue;
+			}
+		}
+		
+		if (cur.len >= GZ_MIN_MATCH)
+		{
+			gz->syms[gz->nsyms++] = (struct gz_sym){.litlen = cur.len, .dist = cur.dist};
+			for (size_t j = i + 1; j < i + cur.len; ++j)
+				gz_insert(gz, j);
+			i += cur.len;
+		}
+		else
+			gz->syms[gz->nsyms++] = (struct gz_sym){.litlen = gz->in[i++]};
+		
+		cur = gz_find(gz, i);
+	}
+	
+	// build the literal/length and distance codes.
+	uint32_t lit_freq[GZ_NLITS] = {0}, dist_freq[GZ_NDISTS] = {0};
+	for (size_t s = 0; s < gz->nsyms; ++s)
+	{
+		if (gz->syms[s].dist)
+		{
+			++lit_freq[257 + gz_code(gz_len_base, GZ_NLENS, gz->syms[s].litlen)];
+			++dist_freq[gz_code(gz_dist_base, GZ_NDISTS, gz->syms[s].dist)];
+		}
+		else
+			++lit_freq[gz->syms[s].litlen];
+	}
+	++lit_freq[256];
+	
+	unsigned char lit_lens[GZ_NLITS], dist_lens[GZ_NDISTS];
+	uint16_t lit_codes[GZ_NLITS], dist_codes[GZ_NDISTS];
+	gz_huff_codes(lit_freq, GZ_NLITS, 15, lit_lens, lit_codes);
+	gz_huff_codes(dist_freq, GZ_NDISTS, 15, dist_lens, dist_codes);
+	
+	int nlits = GZ_NLITS, ndists = GZ_NDISTS;
+	while (nlits > 257 && !lit_lens[nlits - 1])
+		--nlits;
+	while (ndists > 1 && !dist_lens[ndists - 1])
+		--ndists;
+	
+	// run-length encode the code lengths of both codes as one sequence, then
+	// build a code for that.
+	unsigned char lens[GZ_NLITS + GZ_NDISTS];
+	memcpy(lens, lit_lens, nlits);
+	memcpy(&lens[nlits], dist_lens, ndists);
+	
+	unsigned char rle[GZ_NLITS + GZ_NDISTS], rle_extra[GZ_NLITS + GZ_NDISTS];
+	size_t nrle = 0;
+	uint32_t cl_freq[GZ_NCLENS] = {0};
+	for (int l = 0; l < nlits + ndists;)
+	{
+		int run = 1;
+		while (l + run < nlits + ndists && lens[l + run] == lens[l])
+			++run;
+		
+		if (!lens[l] && run >= 3)
+		{
+			run = run > 138 ? 138 : run;
+			rle[nrle] = run >= 11 ? 18 : 17;
+			rle_extra[nrle++] = run >= 11 ? run - 11 : run - 3;
+		}
+		else if (lens[l] && run >= 4)
+		{
+			// the length itself is sent once, then repeated.
+			run = run > 7 ? 7 : run;
+			rle[nrle] = lens[l];
+			rle_extra[nrle++] = 0;
+			++cl_freq[lens[l]];
+			rle[nrle] = 16;
+			rle_extra[nrle++] = run - 4;
+		}
+		else
+		{
+			run = 1;
+			rle[nrle] = lens[l];
+			rle_extra[nrle++] = 0;
+		}
+		
+		++cl_freq[rle[nrle - 1]];
+		l += run;
+	}
+	
+	unsigned char cl_lens[GZ_NCLENS];
+	uint16_t cl_codes[GZ_NCLENS];
+	gz_huff_codes(cl_freq, GZ_NCLENS, 7, cl_lens, cl_codes);
+	
+	static unsigned char const cl_order[GZ_NCLENS] =
+	{
+		16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15,
+	};
+	int nclens = GZ_NCLENS;
+	while (nclens > 4 && !cl_lens[cl_order[nclens - 1]])
+		--nclens;
+	
+	// reserve room for the worst case of every symbol taking its longest
+	// code and most extra bits, besides the block header.
+	size_t need = gz->out_len + gz->nsyms * 6 + 1024;
+	if (need > gz->out_cap)
+	{
+		gz->out_cap = need;
+		gz->out = realloc(gz->out, gz->out_cap);
+	}
+	
+	gz_put_bits(gz, final, 1);
+	gz_put_bits(gz, 2, 2);
+	gz_put_bits(gz, nlits - 257, 5);
+	gz_put_bits(gz, ndists - 1, 5);
+	gz_put_bits(gz, nclens - 4, 4);
+	for (int c = 0; c < nclens; ++c)
+		gz_put_bits(gz, cl_lens[cl_order[c]], 3);
+	
+	static unsigned char const rle_extra_bits[3] = {2, 3, 7};
+	for (size_t r = 0; r < nrle; ++r)
+	{
+		gz_put_bits(gz, cl_codes[rle[r]], cl_lens[rle[r]]);
+		if (rle[r] >= 16)
+			gz_put_bits(gz, rle_extra[r], rle_extra_bits[rle[r] - 16]);
+	}
+	
+	for (size_t s = 0; s < gz->nsyms; ++s)
+	{
+		struct gz_sym const *sym = &gz->syms[s];
+		if (!sym->dist)
+		{
+			gz_put_bits(gz, lit_codes[sym->litlen], lit_lens[sym->litlen]);
+			continue;
+		}
+		
+		int lc = gz_code(gz_len_base, GZ_NLENS, sym->litlen);
+		gz_put_bits(gz, lit_codes[257 + lc], lit_lens[257 + lc]);
+		gz_put_bits(gz, sym->litlen - gz_len_base[lc], gz_len_extra[lc]);
+		
+		int dc = gz_code(gz_dist_base, GZ_NDISTS, sym->dist);
+		gz_put_bits(gz, dist_codes[dc], dist_lens[dc]);
+		gz_put_bits(gz, sym->dist - gz_dist_base[dc], gz_dist_extra[dc]);
+	}
+	gz_put_bits(gz, lit_codes[256], lit_lens[256]);
+	
+	if (final && gz->nbits)
+		gz_put_bits(gz, 0, 8 - gz->nbits);
+	
+	if (gz_flush(gz))
+		return 1;
+	
+	// slide the window, re-indexing the history kept.
+	size_t keep = gz->in_len < GZ_WINDOW ? gz->in_len : GZ_WINDOW;
+	memmove(gz->in, &gz->in[gz->in_len - keep], keep);
+	gz->in_pos = gz->in_len = keep;
+	
+	for (size_t h = 0; h < GZ_HASH_SIZE; ++h)
+		gz->head[h] = -1;
+	for (size_t p = 0; p < keep; ++p)
+		gz_insert(gz, p);
+	
+	return 0;
+}
+
+// index of the last code whose base value is at most `v`.
+static int
+gz_code(uint16_t const *base, int n, unsigned v)
+{
+	int c = n - 1;
+	while (base[c] > v)
+		--c;
+	
+	return c;
+}
+
+// the longest match for the input at `i` within the window.
+static struct gz_match
+gz_find(struct cmfc_gzip const *gz, size_t i)
+{
+	struct gz_match best = {0};
+	if (i + GZ_MIN_MATCH > gz->in_len)
+		return best;
+	
+	size_t max_len = gz->in_len - i < GZ_MAX_MATCH ? gz->in_len - i : GZ_MAX_MATCH;
+	unsigned char const *s = &gz->in[i];
+	int32_t cand = gz->head[gz_hash(s)];
+	for (int chain = 0; cand >= 0 && i - cand <= GZ_WINDOW && chain < GZ_CHAIN; ++chain)
+	{
+		unsigned char const *c = &gz->in[cand];
+		if (c[best.len] == s[best.len] && c[0] == s[0])
+		{
+			size_t len = 0;
+			while (len < max_len && c[len] == s[len])
+				++len;
+			
+			if (len > best.len)
+			{
+				best.len = len;
+				best.dist = i - cand;
+				if (len == max_len)
+					break;
+			}
+		}
+		
+		cand = gz->prev[cand];
+	}
+	
+	return best;
+}
+
+// pass the compressed data produced so far on.
+static int
+gz_flush(struct cmfc_gzip *gz)
+{
+	if (gz->out_len && gz->write(gz->user, (char const *)gz->out, gz->out_len))
+	{
+		gz->failed = true;
+		return 1;
+	}
+	
+	gz->out_len = 0;
+	return 0;
+}
+
+static unsigned
+gz_hash(unsigned char const *s)
+{
+	return ((unsigned)s[0] << 10 ^ (unsigned)s[1] << 5 ^ s[2]) & (GZ_HASH_SIZE - 1);
+}
+
+// build a canonical Huffman code of at most `max_len` bits from symbol
+// frequencies. codes are bit-reversed, as deflate sends them from the most
+// significant bit while bits are packed from the least.
+static void
+gz_huff_codes(uint32_t const *freq, int n, int max_len, unsigned char *lens, uint16_t *codes)
+{
+	// at least two symbols are given codes, as a code of a single symbol
+	// would have no bits.
+	struct gz_huff_sym syms[GZ_NLITS];
+	int nsyms = 0;
+	for (int s = 0; s < n; ++s)
+	{
+		if (freq[s])
+			syms[nsyms++] = (struct gz_huff_sym){.freq = freq[s], .sym = s};
+	}
+	
+	for (int s = 0; nsyms < 2; ++s)
+	{
+		if (!freq[s])
+			syms[nsyms++] = (struct gz_huff_sym){.freq = 1, .sym = s};
+	}
+	
+	qsort(syms, nsyms, sizeof(struct gz_huff_sym), gz_huff_sym_cmp);
+	
+	// code lengths by the in-place algorithm of Moffat and Katajainen, the
+	// frequencies being replaced by lengths, longest first.
+	uint32_t a[GZ_NLITS];
+	for (int s = 0; s < nsyms; ++s)
+		a[s] = syms[s].freq;
+	
+	a[0] += a[1];
+	int root = 0, leaf = 2;
+	for (int next = 1; next < nsyms - 1; ++next)
+	{
+		if (leaf >= nsyms || a[root] < a[leaf])
+		{
+			a[next] = a[root];
+			a[root++] = next;
+		}
+		else
+			a[next] = a[leaf++];
+		
+		if (leaf >= nsyms || (root < next && a[root] < a[leaf]))
+		{
+			a[next] += a[root];
+			a[root++] = next;
+		}
+		else
+			a[next] += a[leaf++];
+	}
+	
+	a[nsyms - 2] = 0;
+	for (int next = nsyms - 3; next >= 0; --next)
+		a[next] = a[a[next]] + 1;
+	
+	int avail = 1, used = 0, depth = 0, next = nsyms - 1;
+	root = nsyms - 2;
+	while (avail > 0)
+	{
+		while (root >= 0 && (int)a[root] == depth)
+		{
+			++used;
+			--root;
+		}
+		
+		while (avail > used)
+		{
+			a[next--] = depth;
+			--avail;
+		}
+		
+		avail = 2 * used;
+		++depth;
+		used = 0;
+	}
+	
+	// limit the lengths, moving overlong codes to the limit and lengthening
+	// shorter ones until the code is complete again.
+	int count[GZ_MAX_BITS + 1] = {0};
+	for (int s = 0; s < nsyms; ++s)
+		++count[a[s] > (uint32_t)max_len ? max_len : a[s]];
+	
+	uint32_t kraft = 0;
+	for (int l = 1; l <= max_len; ++l)
+		kraft += (uint32_t)count[l] << (max_len - l);
+	
+	while (kraft > 1u << max_len)
+	{
+		--count[max_len];
+		for (int l = max_len - 1; l > 0; --l)
+		{
+			if (count[l])
+			{
+				--count[l];
+				count[l + 1] += 2;
+				break;
+			}
+		}
+		--kraft;
+	}
+	
+	memset(lens, 0, n);
+	for (int l = max_len, s = 0; l > 0; --l)
+	{
+		for (int c = 0; c < count[l]; ++c)
+			lens[syms[s++].sym] = l;
+	}
+	
+	// assign canonical codes in order of length, then of symbol.
+	uint16_t next_code[GZ_MAX_BITS + 2] = {0};
+	for (int l = 1, code = 0; l <= max_len; ++l)
+	{
+		code = (code + count[l - 1]) << 1;
+		next_code[l] = code;
+	}
+	
+	for (int s = 0; s < n; ++s)
+	{
+		if (!lens[s])
+			continue;
+		
+		unsigned code = next_code[lens[s]]++, rev = 0;
+		for (int b = 0; b < lens[s]; ++b)
+			rev |= (code >> b & 1) << (lens[s] - 1 - b);
+		codes[s] = rev;
+	}
+}
+
+// order symbols from least to most frequent.
+static int
+gz_huff_sym_cmp(void const *a, void const *b)
+{
+	struct gz_huff_sym const *sa = a, *sb = b;
+	if (sa->freq != sb->freq)
+		return sa->freq < sb->freq ? -1 : 1;
+	
+	return sa->sym - sb->sym;
+}
+
+static void
+gz_insert(struct cmfc_gzip *gz, size_t i)
+{
+	if (i + GZ_MIN_MATCH > gz->in_len)
+		return;
+	
+	unsigned h = gz_hash(&gz->in[i]);
+	gz->prev[i] = gz->head[h];
+	gz->head[h] = i;
+}
+
+// append bits to the output, least significant first. the caller reserves
+// room for them.
+static void
+gz_put_bits(struct cmfc_gzip *gz, unsigned bits, int n)
+{
+	gz->bits |= (uint64_t)bits << gz->nbits;
+	gz->nbits += n;
+	while (gz->nbits >= 8)
+	{
+		gz->out[gz->out_len++] = gz->bits & 0xff;
+		gz->bits >>= 8;
+		gz->nbits -= 8;
+	}
+}
+
+// the slot a probe sequence begins at in a hash table of `cap` slots. strings
+// differing only in their last bytes, e.g. numbered ones, hash to values
+// differing mostly in their high bits, which are mixed down.
+static size_t
+hash_slot(uint64_t hash, size_t cap)
+{
+	hash ^= hash >> 32;
+	return (hash * 0x9e3779b97f4a7c15ull >> 32) & (cap - 1);
+}
+
+// give a title an id derived from its text, the words of which are joined by
+// hyphens. ids already taken are suffixed with the lowest number making them
+// unique. returns nonzero if out of memory.
+static int
+heading_add(struct heading_table *ht, struct node const *node)
+{
+	char const *text = node->data[0];
+	char *id = arena_alloc(&ht->arena, strlen(text) + 32);
+	if (!id)
+		return 1;
+	
+	size_t len = 0, pos = 0, word_len;
+	while ((word_len = text_word(text, &pos, &id[len ? len + 1 : 0], node->raw_text)))
+	{
+		if (len)
+			id[len++] = '-';
+		len += word_len;
+	}
+	
+	if (!len)
+	{
+		strcpy(id, "section");
+		len = strlen(id);
+	}
+	id[len] = 0;
+	
+	if (heading_grow(ht))
+		return 1;
+	
+	// titles repeating an id try suffixes from where the last of them left
+	// off, so that many repeats take linear time. every lower suffix is taken.
+	// footnote ids are taken as well.
+	uint64_t hash = cmfc_hash(CMFC_HASH_INIT, id, len);
+	size_t i = heading_slot(ht, id, hash);
+	if (ht->slots[i])
+	{
+		struct heading *base = &ht->headings[ht->slots[i] - 1];
+		unsigned long n = base->suffix;
+		for (;; ++n)
+		{
+			sprintf(&id[len], "-%lu", n);
+			hash = cmfc_hash(CMFC_HASH_INIT, id, strlen(id));
+			i = heading_slot(ht, id, hash);
+			if (!ht->slots[i])
+				break;
+		}
+		base->suffix = n + 1;
+	}
+	
+	ht->headings[ht->nheadings] = (struct heading)
+	{
+		.id = id,
+		.text = text,
+		.hash = hash,
+		.level = node->arg,
+		.suffix = 1,
+	};
+	ht->slots[i] = ++ht->nheadings;
+	
+	return 0;
+}
+
+// make room for one more heading. returns nonzero if out of memory.
+static int
+heading_grow(struct heading_table *ht)
+{
+	if (ht->nheadings >= ht->headings_cap)
+	{
+		size_t cap = ht->headings_cap ? 2 * ht->headings_cap : 16;
+		struct heading *headings = reallocarray(ht->headings, cap, sizeof(struct heading));
+		if (!headings)
+			return 1;
+		
+		ht->headings = headings;
+		ht->headings_cap = cap;
+	}
+	
+	// the table is kept at most half full.
+	if (2 * (ht->nheadings + 1) > ht->cap)
+	{
+		size_t cap = ht->cap ? 2 * ht->cap : 16;
+		size_t *slots = calloc(cap, sizeof(size_t));
+		if (!slots)
+			return 1;
+		
+		free(ht->slots);
+		ht->slots = slots;
+		ht->cap = cap;
+		for (size_t h = 0; h < ht->nheadings; ++h)
+		{
+			size_t i = hash_slot(ht->headings[h].hash, ht->cap);
+			while (ht->slots[i])
+				i = (i + 1) & (ht->cap - 1);
+			ht->slots[i] = h + 1;
+		}
+	}
+	
+	return 0;
+}
+
+// take the id of a footnote, which must outlive the table, so that no title is
+// given it. returns 1 if out of memory, or -1 if a title was given it already.
+static int
+heading_reserve(struct heading_table *ht, char const *id)
+{
+	if (heading_grow(ht))
+		return 1;
+	
+	uint64_t hash = cmfc_hash(CMFC_HASH_INIT, id, strlen(id));
+	size_t i = heading_slot(ht, id, hash);
+	if (ht->slots[i])
+		return ht->headings[ht->slots[i] - 1].level ? -1 : 0;
+	
+	ht->headings[ht->nheadings] = (struct heading)
+	{
+		.id = id,
+		.text = "",
+		.hash = hash,
+		.suffix = 1,
+	};
+	ht->slots[i] = ++ht->nheadings;
+	++ht->nfootnotes;
+	
+	return 0;
+}
+
+// the slot holding a heading's id, or the empty slot it would be put in.
+static size_t
+heading_slot(struct heading_table const *ht, char const *id, uint64_t hash)
+{
+	size_t mask = ht->cap - 1, i;
+	for (i = hash_slot(hash, ht->cap); ht->slots[i]; i = (i + 1) & mask)
+	{
+		struct heading const *h = &ht->headings[ht->slots[i] - 1];
+		if (h->hash == hash && !strcmp(h->id, id))
+			break;
+	}
+	
+	return i;
+}
+
+static void
+heading_table_release(struct heading_table *ht)
+{
+	free(ht->headings);
+	free(ht->slots);
+	arena_release(&ht->arena);
+}
+
+#ifdef HTMLIFY_CHECK
+// the original byte-at-a-time HTMLify implementation, against which the fast
+// path is checked on every call in HTMLIFY_CHECK builds.
+static char *
+htmlify_ref(bool raw_text, char const *s, size_t lb, size_t ub, enum htmlify_state hstate)
+{
+	char *sub = calloc(1, sizeof(char));
+	size_t slen = 0, scap = 1;
+	
+	for (size_t i = lb; i < ub; ++i)
+	{
+		if (raw_text)
+		{
+			str_dyn_append_c(&sub, &slen, &scap, s[i]);
+			continue;
+		}
+		else if (i + 1 < ub && s[i] == '\\')
+		{
+			++i;
+			
+			if (HS_IS_TEXT(hstate) && entity_char(s[i]))
+				str_dyn_append_s(&sub, &slen, &scap, entity_char(s[i]));
+			else if (HS_IS_RAW(hstate) && s[i] == '"')
+				str_dyn_append_s(&sub, &slen, &scap, "%22");
+			else
+				str_dyn_append_c(&sub, &slen, &scap, s[i]);
+			
+			continue;
+		}
+		else if (HS_IS_TEXT(hstate)
+		         && i + 1 < ub
+		         && !strncmp(&s[i], "@[", 2))
+		{
+			++i;
+			str_dyn_append_s(&sub, &slen, &scap, "<a href=\"");
+			hstate |= HS_LINK_REF;
+			continue;
+		}
+		else if (HS_IS_TEXT(hstate)
+		         && i + 1 < ub
+		         && !strncmp(&s[i], "[^", 2))
+		{
+			++i;
+			str_dyn_append_s(&sub, &slen, &scap, "<sup><a href=\"#");
+			hstate |= HS_FOOTNOTE_REF;
+			continue;
+		}
+		else if (hstate & HS_LINK_REF && s[i] == '|')
+		{
+			hstate &= ~HS_LINK_REF;
+			hstate |= HS_LINK_TEXT;
+			str_dyn_append_s(&sub, &slen, &scap, "\">");
+			continue;
+		}
+		else if (hstate & HS_LINK_TEXT && s[i] == ']')
+		{
+			hstate &= ~HS_LINK_TEXT;
+			str_dyn_append_s(&sub, &slen, &scap, "</a>");
+			continue;
+		}
+		else if (hstate & HS_FOOTNOTE_REF && s[i] == '|')
+		{
+			hstate &= ~HS_FOOTNOTE_REF;
+			hstate |= HS_FOOTNOTE_TEXT;
+			str_dyn_append_s(&sub, &slen, &scap, "\">[");
+			continue;
+		}
+		else if (hstate & HS_FOOTNOTE_TEXT && s[i] == ']')
+		{
+			hstate &= ~HS_FOOTNOTE_TEXT;
+			str_dyn_append_s(&sub, &slen, &scap, "]</a></sup>");
+			continue;
+		}
+		else if (HS_IS_TEXT(hstate) && s[i] == '`')
+		{
+			if (hstate & HS_CODE)
+			{
+				hstate &= ~HS_CODE;
+				str_dyn_append_s(&sub, &slen, &scap, "</code>");
+			}
+			else
+			{
+				hstate |= HS_CODE;
+				str_dyn_append_s(&sub, &slen, &scap, "<code>");
+			}
+			continue;
+		}
+		else if (HS_IS_TEXT(hstate)
+		         && i + 1 < ub
+		         && !strncmp(&s[i], "**", 2))
+		{
+			++i;
+			if (hstate & HS_BOLD)
+			{
+				hstate &= ~HS_BOLD;
+				str_dyn_append_s(&sub, &slen, &scap, "</b>");
+			}
+			else
+			{
+				hstate |= HS_BOLD;
+				str_dyn_append_s(&sub, &slen, &scap, "<b>");
+			}
+			continue;
+		}
+		else if (HS_IS_TEXT(hstate) && s[i] == '*')
+		{
+			if (hstate & HS_ITALIC)
+			{
+				hstate &= ~HS_ITALIC;
+				str_dyn_append_s(&sub, &slen, &scap, "</i>");
+			}
+			else
+			{
+				hstate |= HS_ITALIC;
+				str_dyn_append_s(&sub, &slen, &scap, "<i>");
+			}
+			continue;
+		}
+		else if (HS_IS_TEXT(hstate) && entity_char(s[i]))
+		{
+			str_dyn_append_s(&sub, &slen, &scap, entity_char(s[i]));
+			continue;
+		}
+		else if (HS_IS_RAW(hstate) && s[i] == '"')
+		{
+			str_dyn_append_s(&sub, &slen, &scap, "%22");
+			continue;
+		}
+		else if (HS_IS_TEXT(hstate) && i + 2 < ub && !strncmp(&s[i], "---", 3))
+		{
+			str_dyn_append_s(&sub, &slen, &scap, "&mdash;");
+			i += 2;
+			continue;
+		}
+		else if (HS_IS_TEXT(hstate) && i + 1 < ub && !strncmp(&s[i], "--", 2))
+		{
+			str_dyn_append_s(&sub, &slen, &scap, "&ndash;");
+			++i;
+			continue;
+		}
+		else if (HS_IS_TEXT(hstate) && i + 1 < ub && !strncmp(&s[i], "//", 2))
+		{
+			str_dyn_append_s(&sub, &slen, &scap, "<br>");
+			++i;
+			continue;
+		}
+		
+		// if not special, just add the character.
+		{
+			str_dyn_append_c(&sub, &slen, &scap, s[i]);
+		}
+	}
+	
+	// terminate any unterminated HTMLify states.
+	{
+		if (hstate & HS_LINK_REF)
+			str_dyn_append_s(&sub, &slen, &scap, "\"></a>");
+		else if (hstate & HS_LINK_TEXT)
+			str_dyn_append_s(&sub, &slen, &scap, "</a>");
+		
+		if (hstate & HS_FOOTNOTE_REF)
+			str_dyn_append_s(&sub, &slen, &scap, "\">[]</a></sup>");
+		else if (hstate & HS_FOOTNOTE_TEXT)
+			str_dyn_append_s(&sub, &slen, &scap, "]</a></sup>");
+		
+		if (hstate & HS_CODE)
+			str_dyn_append_s(&sub, &slen, &scap, "</code>");
+		if (hstate & HS_ITALIC)
+			str_dyn_append_s(&sub, &slen, &scap, "</i>");
+		if (hstate & HS_BOLD)
+			str_dyn_append_s(&sub, &slen, &scap, "</b>");
+	}
+	
+	return sub;
+}
+
+static void
+htmlify_check(struct doc_ctx *ctx, char const *s, size_t lb, size_t ub, enum htmlify_state hstate)
+{
+	char *ref = htmlify_ref(ctx->raw_text, s, lb, ub, hstate);
+	if (strcmp(ref, ctx->scratch))
+	{
+		fprintf(stderr,
+		        "err: HTMLify mismatch at %zu..%zu!\n"
+		        "expected: %s\n"
+		        "got:      %s\n",
+		        lb,
+		        ub,
+		        ref,
+		        ctx->scratch);
+		abort();
+	}
+	free(ref);
+}
+#endif
+
+// HTMLify a substring into the scratch buffer of `ctx`, returning its length.
+static size_t
+htmlify(struct doc_ctx *ctx, char const *s, size_t lb, size_t ub, enum htmlify_state hstate)
+{
+	if (!ctx->scratch)
+	{
+		ctx->scratch_cap = 64;
+		ctx->scratch = malloc(ctx->scratch_cap);
+	}
+	
+	char **sub = &ctx->scratch;
+	size_t slen = 0, *scap = &ctx->scratch_cap;
+	**sub = 0;
+	
+#ifdef CMFC_BENCH
+	if (bench_no_htmlify)
+		return 0;
+#endif
+
+#ifdef HTMLIFY_CHECK
+	enum htmlify_state hstate_init = hstate;
+#endif
+	
+	// where the name of the footnote reference being HTMLified begins, in
+	// the markup and the output.
+	size_t fn_pos = 0, fn_begin = 0;
+	
+	for (size_t i = lb; i < ub; ++i)
+	{
+		// copy runs of plain bytes in bulk, only special bytes need to go
+		// through the state machine below. raw text is entirely plain.
+		{
+			size_t end = ub;
+			if (!ctx->raw_text)
+			{
+				end = i;
+				while (end < ub && !htmlify_special[(unsigned char)s[end]])
+					++end;
+			}
+			
+			if (end > i)
+			{
+				str_dyn_append_n(sub, &slen, scap, &s[i], end - i);
+				i = end;
+				if (i >= ub)
+					break;
+			}
+		}
+		
+		if (i + 1 < ub && s[i] == '\\')
+		{
+			++i;
+			
+			if (HS_IS_TEXT(hstate) && entity_char(s[i]))
+				str_dyn_append_s(sub, &slen, scap, entity_char(s[i]));
+			else if (HS_IS_RAW(hstate) && s[i] == '"')
+				str_dyn_append_s(sub, &slen, scap, "%22");
+			else
+				str_dyn_append_c(sub, &slen, scap, s[i]);
+			
+			continue;
+		}
+		else if (HS_IS_TEXT(hstate)
+		         && i + 1 < ub
+		         && !strncmp(&s[i], "@[", 2))
+		{
+			++i;
+			str_dyn_append_s(sub, &slen, scap, "<a href=\"");
+			hstate |= HS_LINK_REF;
+			continue;
+		}
+		else if (HS_IS_TEXT(hstate)
+		         && i + 1 < ub
+		         && !strncmp(&s[i], "[^", 2))
+		{
+			fn_pos = i++;
+			str_dyn_append_s(sub, &slen, scap, "<sup><a href=\"#");
+			fn_begin = slen;
+			hstate |= HS_FOOTNOTE_REF;
+			continue;
+		}
+		else if (hstate & HS_LINK_REF && s[i] == '|')
+		{
+			hstate &= ~HS_LINK_REF;
+			hstate |= HS_LINK_TEXT;
+			str_dyn_append_s(sub, &slen, scap, "\">");
+			continue;
+		}
+		else if (hstate & HS_LINK_TEXT && s[i] == ']')
+		{
+			hstate &= ~HS_LINK_TEXT;
+			str_dyn_append_s(sub, &slen, scap, "</a>");
+			continue;
+		}
+		else if (hstate & HS_FOOTNOTE_REF && s[i] == '|')
+		{
+			hstate &= ~HS_FOOTNOTE_REF;
+			hstate |= HS_FOOTNOTE_TEXT;
+			size_t num = footnote_mention(ctx, &(*sub)[fn_begin], slen - fn_begin, fn_pos, false);
+			str_dyn_append_s(sub, &slen, scap, "\">[");
+			
+			// the text of a renumbered reference is replaced by its number.
+			if (num)
+			{
+				char num_str[32];
+				str_dyn_append_n(sub, &slen, scap, num_str, snprintf(num_str, sizeof(num_str), "%zu", num));
+				
+				size_t end = i + 1;
+				while (end < ub && s[end] != ']')
+					end += end + 1 < ub && s[end] == '\\' ? 2 : 1;
+				i = end - 1;
+			}
+			continue;
+		}
+		else if (hstate & HS_FOOTNOTE_TEXT && s[i] == ']')
+		{
+			hstate &= ~HS_FOOTNOTE_TEXT;
+			str_dyn_append_s(sub, &slen, scap, "]</a></sup>");
+			continue;
+		}
+		else if (HS_IS_TEXT(hstate) && s[i] == '`')
+		{
+			if (hstate & HS_CODE)
+			{
+				hstate &= ~HS_CODE;
+				str_dyn_append_s(sub, &slen, scap, "</code>");
+			}
+			else
+			{
+				hstate |= HS_CODE;
+				str_dyn_append_s(sub, &slen, scap, "<code>");
+			}
+			continue;
+		}
+		else if (HS_IS_TEXT(hstate)
+		         && i + 1 < ub
+		         && !strncmp(&s[i], "**", 2))
+		{
+			++i;
+			if (hstate & HS_BOLD)
+			{
+				hstate &= ~HS_BOLD;
+				str_dyn_append_s(sub, &slen, scap, "</b>");
+			}
+			else
+			{
+				hstate |= HS_BOLD;
+				str_dyn_append_s(sub, &slen, scap, "<b>");
+			}
+			continue;
+		}
+		else if (HS_IS_TEXT(hstate) && s[i] == '*')
+		{
+			if (hstate & HS_ITALIC)
+			{
+				hstate &= ~HS_ITALIC;
+				str_dyn_append_s(sub, &slen, scap, "</i>");
+			}
+			else
+			{
+				hstate |= HS_ITALIC;
+				str_dyn_append_s(sub, &slen, scap, "<i>");
+			}
+			continue;
+		}
+		else if (HS_IS_TEXT(hstate) && entity_char(s[i]))
+		{
+			str_dyn_append_s(sub, &slen, scap, entity_char(s[i]));
+			continue;
+		}
+		else if (HS_IS_RAW(hstate) && s[i] == '"')
+		{
+			str_dyn_append_s(sub, &slen, scap, "%22");
+			continue;
+		}
+		else if (HS_IS_TEXT(hstate) && i + 2 < ub && !strncmp(&s[i], "---", 3))
+		{
+			str_dyn_append_s(sub, &slen, scap, "&mdash;");
+			i += 2;
+			continue;
+		}
+		else if (HS_IS_TEXT(hstate) && i + 1 < ub && !strncmp(&s[i], "--", 2))
+		{
+			str_dyn_append_s(sub, &slen, scap, "&ndash;");
+			++i;
+			continue;
+		}
+		else if (HS_IS_TEXT(hstate) && i + 1 < ub && !strncmp(&s[i], "//", 2))
+		{
+			str_dyn_append_s(sub, &slen, scap, "<br>");
+			++i;
+			continue;
+		}
+		
+		// if not special, just add the character.
+		{
+			str_dyn_append_c(sub, &slen, scap, s[i]);
+		}
+	}
+	
+	// terminate any unterminated HTMLify states.
+	{
+		if (hstate & HS_LINK_REF)
+			str_dyn_append_s(sub, &slen, scap, "\"></a>");
+		else if (hstate & HS_LINK_TEXT)
+			str_dyn_append_s(sub, &slen, scap, "</a>");
+		
+		if (hstate & HS_FOOTNOTE_REF)
+		{
+			size_t num = footnote_mention(ctx, &(*sub)[fn_begin], slen - fn_begin, fn_pos, false);
+			str_dyn_append_s(sub, &slen, scap, "\">[");
+			if (num)
+			{
+				char num_str[32];
+				str_dyn_append_n(sub, &slen, scap, num_str, snprintf(num_str, sizeof(num_str), "%zu", num));
+			}
+			str_dyn_append_s(sub, &slen, scap, "]</a></sup>");
+		}
+		else if (hstate & HS_FOOTNOTE_TEXT)
+			str_dyn_append_s(sub, &slen, scap, "]</a></sup>");
+		
+		if (hstate & HS_CODE)
+			str_dyn_append_s(sub, &slen, scap, "</code>");
+		if (hstate & HS_ITALIC)
+			str_dyn_append_s(sub, &slen, scap, "</i>");
+		if (hstate & HS_BOLD)
+			str_dyn_append_s(sub, &slen, scap, "</b>");
+	}
+	
+#ifdef HTMLIFY_CHECK
+	// renumbered references depend on the rest of the document, which the
+	// original implementation knows nothing of.
+	if (!ctx->fn_renumber)
+		htmlify_check(ctx, s, lb, ub, hstate_init);
+#endif
+	
+	return slen;
+}
+
+// returns NULL if out of memory, failing the compile. mentioning a footnote
+// may have run out of memory already.
+static char *
+htmlified_substr(struct doc_ctx *ctx, char const *s, size_t lb, size_t ub, enum htmlify_state hstate)
+{
+	size_t len = htmlify(ctx, s, lb, ub, hstate);
+	char *sub = ctx->err_set ? NULL : arena_strndup(&ctx->arena, ctx->scratch, len);
+	if (!sub)
+		doc_oom(ctx);
+	
+	return sub;
+}
+
+// returns nonzero if out of memory, failing the compile.
+static int
+node_add_child(struct doc_ctx *ctx, struct node *node, struct node *child)
+{
+	if (node->nchildren >= node->children_cap)
+	{
+		size_t new_cap = node->children_cap ? 2 * node->children_cap : 4;
+		struct node *children = arena_realloc(&ctx->arena,
+		                                      node->children,
+		                                      node->children_cap * sizeof(struct node),
+		                                      new_cap * sizeof(struct node));
+		if (!children)
+			return doc_oom(ctx);
+		
+		node->children = children;
+		node->children_cap = new_cap;
+	}
+	
+	node->children[node->nchildren++] = *child;
+	
+	return 0;
+}
+
+static void
+node_print(struct out_buf *ob, struct node const *node, int depth)
+{
+	// pad out appropriate depth.
+	{
+		for (int i = 0; i < depth; ++i)
+			OUT_LIT(ob, "  ");
+	}
+	
+	// write out node information.
+	{
+		char arg[16];
+		out_str(ob, node_type_names[node->type]);
+		out_append(ob, arg, snprintf(arg, sizeof(arg), ": %d", node->arg));
+		for (size_t i = 0; i < sizeof(node->data) / sizeof(char *); ++i)
+		{
+			if (node->data[i])
+			{
+				OUT_LIT(ob, " ");
+				out_str(ob, node->data[i]);
+			}
+		}
+		OUT_LIT(ob, "\n");
+	}
+	
+	// recursively print out children.
+	{
+		for (size_t i = 0; i < node->nchildren; ++i)
+			node_print(ob, &node->children[i], depth + 1);
+	}
+}
+
+// pass the words of the text of a node and its children to the word callback.
+// code, images and the names of footnotes are not text. children are left raw
+// or HTMLified as their parent.
+static void
+node_words(struct doc_ctx *ctx, struct node const *node, bool raw_text)
+{
+	switch (node->type)
+	{
+	case NT_TITLE:
+	case NT_PARAGRAPH:
+	case NT_LIST_ITEM:
+	case NT_BLOCKQUOTE:
+	case NT_TABLE_ITEM:
+		text_words(ctx, node->data[0], raw_text);
+		break;
+	case NT_FOOTNOTE:
+		text_words(ctx, node->data[1], raw_text);
+		break;
+	default:
+		break;
+	}
+	
+	for (size_t i = 0; i < node->nchildren; ++i)
+		node_words(ctx, &node->children[i], raw_text);
+}
+
+static void
+out_append(struct out_buf *ob, char const *s, size_t n)
+{
+	// grow output buffer as necessary.
+	if (ob->limit && ob->flushed + ob->len + n > ob->limit)
+	{
+		ob->over = true;
+		return;
+	}
+	
+	if (ob->len + n > ob->cap)
+	{
+		if (ob->fixed)
+		{
+			ob->len += n;
+			return;
+		}
+		
+		ob->cap = ob->cap ? ob->cap : 4096;
+		while (ob->len + n > ob->cap)
+			ob->cap *= 2;
+		ob->data = realloc(ob->data, ob->cap);
+	}
+	
+	memcpy(&ob->data[ob->len], s, n);
+	ob->len += n;
+}
+
+// pass the buffered output on to the caller.
+static int
+out_flush(struct out_buf *ob, cmfc_write_fn write, void *user)
+{
+	if (ob->len && write(user, ob->data, ob->len))
+		return 1;
+	
+	ob->flushed += ob->len;
+	ob->len = 0;
+	return 0;
+}
+
+// fail the compile if its output has gone past the limit.
+static int
+out_limit_check(struct doc_ctx *ctx)
+{
+	if (!ctx->out.over)
+		return 0;
+	
+	char msg[128];
+	snprintf(msg, sizeof(msg), "output exceeds the limit of %zu bytes", ctx->out.limit);
+	doc_err(ctx, msg);
+	return 1;
+}
+
+// append output with its newlines left out.
+static void
+out_minified(struct out_buf *ob, char const *s, size_t n)
+{
+	for (char const *nl; (nl = memchr(s, '\n', n));)
+	{
+		out_append(ob, s, nl - s);
+		n -= nl + 1 - s;
+		s = nl + 1;
+	}
+	out_append(ob, s, n);
+}
+
+static void
+out_str(struct out_buf *ob, char const *s)
+{
+	out_append(ob, s, strlen(s));
+}
+
+static int
+parse(struct doc_ctx *ctx, struct node *out, char const *data, size_t len, char const *file)
+{
+	if (out && ctx->parse_jobs > 1 && len >= PARALLEL_PARSE_MIN)
+		return parse_parallel(ctx, out, data, len, file);
+	
+	if (out)
+	{
+		*out = (struct node)
+		{
+			.type = NT_ROOT,
+		};
+	}
+	
+	for (size_t i = 0; i < len;)
+	{
+		struct node child;
+		enum parse_status rc = parse_any(ctx, out ? &child : NULL, &i, data, len, file);
+		switch (rc)
+		{
+		case PS_OK:
+			if (out && node_add_child(ctx, out, &child))
+				return 1;
+			break;
+		case PS_ERR:
+			return 1;
+		case PS_SKIP:
+			break;
+		}
+	}
+	
+	return 0;
+}
+
+static enum parse_status
+parse_any(struct doc_ctx *ctx,
+          struct node *out,
+          size_t *i,
+          char const *data,
+          size_t len,
+          char const *file)
+{
+	enum parse_status rc;
+	switch (block_type(data, *i))
+	{
+	case NT_TITLE:
+		rc = parse_title(ctx, out, i, data, file);
+		break;
+	case NT_U_LIST:
+		rc = parse_u_list(ctx, out, i, data, len, file);
+		break;
+	case NT_O_LIST:
+		rc = parse_o_list(ctx, out, i, data, len, file);
+		break;
+	case NT_BLOCKQUOTE:
+		rc = parse_blockquote(ctx, out, i, data);
+		break;
+	case NT_LONG_CODE:
+		rc = parse_long_code(ctx, out, i, data);
+		break;
+	case NT_TABLE:
+		rc = parse_table(ctx, out, i, data, len, file);
+		break;
+	case NT_IMAGE:
+		rc = parse_image(ctx, out, i, data);
+		break;
+	case NT_FOOTNOTE:
+		rc = parse_footnote(ctx, out, i, data, len);
+		break;
+	case NT_PARAGRAPH:
+		rc = parse_paragraph(ctx, out, i, data);
+		break;
+	default:
+		if (!strncmp("DOC", &data[*i], 3))
+			return parse_doc(ctx, i, data, file);
+		
+		++*i;
+		return PS_SKIP;
+	}
+	
+	// the raw text state only changes between blocks, so it holds for the
+	// whole of the node and its children.
+	if (out && rc == PS_OK)
+		out->raw_text = ctx->raw_text;
+	
+	return rc;
+}
+
+static enum parse_status
+parse_blockquote(struct doc_ctx *ctx, struct node *out, size_t *i, char const *data)
+{
+	*i += 6;
+	size_t begin = *i;
+	*i = block_end(data, *i, BE_BLANK);
+	
+	if (out)
+	{
+		*out = (struct node)
+		{
+			.type = NT_BLOCKQUOTE,
+		};
+		out->data[0] = htmlified_substr(ctx, data, begin, *i, HS_NONE);
+		if (!out->data[0])
+			return PS_ERR;
+	}
+	
+	return PS_OK;
+}
+
+static enum parse_status
+parse_doc(struct doc_ctx *ctx, size_t *i, char const *data, char const *file)
+{
+	if (!strncmp("DOC-TITLE ", &data[*i], 10))
+	{
+		*i += 10;
+		size_t begin = *i;
+		*i += strcspn(&data[*i], "\n");
+		
+		ctx->doc_data.title = htmlified_substr(ctx, data, begin, *i, HS_NONE);
+		ctx->doc_data.raw_title = ctx->raw_text;
+		if (!ctx->doc_data.title)
+			return PS_ERR;
+	}
+	else if (!strncmp("DOC-SUBTITLE ", &data[*i], 13))
+	{
+		*i += 13;
+		size_t begin = *i;
+		*i += strcspn(&data[*i], "\n");
+		
+		ctx->doc_data.subtitle = htmlified_substr(ctx, data, begin, *i, HS_NONE);
+		ctx->doc_data.raw_subtitle = ctx->raw_text;
+		if (!ctx->doc_data.subtitle)
+			return PS_ERR;
+	}
+	else if (!strncmp("DOC-AUTHOR ", &data[*i], 11))
+	{
+		*i += 11;
+		size_t begin = *i;
+		*i += strcspn(&data[*i], "\n");
+		
+		ctx->doc_data.author = htmlified_substr(ctx, data, begin, *i, HS_NONE);
+		if (!ctx->doc_data.author)
+			return PS_ERR;
+	}
+	else if (!strncmp("DOC-CREATED ", &data[*i], 12))
+	{
+		*i += 12;
+		size_t begin = *i;
+		*i += strcspn(&data[*i], "\n");
+		
+		ctx->doc_data.created = htmlified_substr(ctx, data, begin, *i, HS_NONE);
+		if (!ctx->doc_data.created)
+			return PS_ERR;
+	}
+	else if (!strncmp("DOC-REVISED ", &data[*i], 12))
+	{
+		*i += 12;
+		size_t begin = *i;
+		*i += strcspn(&data[*i], "\n");
+		
+		ctx->doc_data.revised = htmlified_substr(ctx, data, begin, *i, HS_NONE);
+		if (!ctx->doc_data.revised)
+			return PS_ERR;
+	}
+	else if (!strncmp("DOC-LICENSE ", &data[*i], 12))
+	{
+		*i += 12;
+		size_t begin = *i;
+		*i += strcspn(&data[*i], "\n");
+		
+		ctx->doc_data.license = htmlified_substr(ctx, data, begin, *i, HS_NONE);
+		if (!ctx->doc_data.license)
+			return PS_ERR;
+	}
+	else if (!strncmp("DOC-FAVICON ", &data[*i], 12))
+	{
+		*i += 12;
+		size_t begin = *i;
+		*i += strcspn(&data[*i], "\n");
+		
+		ctx->doc_data.favicon = htmlified_substr(ctx, data, begin, *i, HS_NONE);
+		if (!ctx->doc_data.favicon)
+			return PS_ERR;
+	}
+	else if (!strncmp("DOC-RAW-TEXT ", &data[*i], 13))
+	{
+		*i += 13;
+		if (!data[*i] || !strchr("01", data[*i]))
+		{
+			prog_err(ctx, file, data, *i, "expected 0 or 1 after DOC-RAW-TEXT");
+			return PS_ERR;
+		}
+		
+		ctx->raw_text = data[*i] - '0';
+		
+		*i += strcspn(&data[*i], "\n");
+	}
+	else
+	{
+		prog_err(ctx, file, data, *i, "unknown DOC directive");
+		return PS_ERR;
+	}
+	
+	return PS_SKIP;
+}
+
+static enum parse_status
+parse_footnote(struct doc_ctx *ctx, struct node *out, size_t *i, char const *data, size_t len)
+{
+	size_t start = *i;
+	
+	char *name;
+	{
+		*i += 2;
+		size_t begin = *i;
+		while (data[*i] && data[*i] != ']')
+		{
+			if (*i + 1 < len && data[*i] == '\\')
+				++*i;
+			++*i;
+		}
+		
+		name = out ? htmlified_substr(ctx, data, begin, *i, HS_FORCE_RAW) : NULL;
+		if (out && !name)
+			return PS_ERR;
+	}
+	
+	char *text;
+	{
+		// an unterminated name runs to the end of the markup.
+		if (data[*i])
+			++*i;
+		size_t begin = *i;
+		*i = block_end(data, *i, BE_BLANK);
+		
+		text = out ? htmlified_substr(ctx, data, begin, *i, HS_NONE) : NULL;
+		if (out && !text)
+			return PS_ERR;
+	}
+	
+	if (out)
+	{
+		// renumbered footnotes begin with their number.
+		size_t num = footnote_mention(ctx, name, strlen(name), start, true);
+		if (ctx->err_set)
+			return PS_ERR;
+		
+		if (num)
+		{
+			char prefix[32];
+			size_t prefix_len = snprintf(prefix, sizeof(prefix), "<b>[%zu]</b>:", num);
+			size_t text_len = strlen(text);
+			char *numbered = arena_alloc(&ctx->arena, prefix_len + text_len + 1);
+			if (!numbered)
+				return doc_oom(ctx);
+			
+			memcpy(numbered, prefix, prefix_len);
+			memcpy(&numbered[prefix_len], text, text_len + 1);
+			text = numbered;
+		}
+		
+		*out = (struct node)
+		{
+			.type = NT_FOOTNOTE,
+		};
+		out->data[0] = name;
+		out->data[1] = text;
+	}
+	
+	return PS_OK;
+}
+
+// first pass of a parallel parse, which finds the extent and raw text state of
+// every block producing a node. nothing is HTMLified except for DOC directives,
+// which are applied to `ctx` as in a normal parse.
+static int
+parse_index(struct doc_ctx *ctx,
+            struct block **out,
+            size_t *out_len,
+            char const *data,
+            size_t len,
+            char const *file)
+{
+	struct block *blocks = NULL;
+	size_t nblocks = 0, cap = 0;
+	
+	for (size_t i = 0; i < len;)
+	{
+		struct block b =
+		{
+			.begin = i,
+			.type = block_type(data, i),
+			.raw_text = ctx->raw_text,
+		};
+		
+		enum parse_status rc = parse_any(ctx, NULL, &i, data, len, file);
+		if (rc == PS_ERR)
+		{
+			free(blocks);
+			return 1;
+		}
+		else if (rc == PS_SKIP)
+			continue;
+		
+		b.end = i;
+		
+		if (nblocks >= cap)
+		{
+			cap = cap ? 2 * cap : 256;
+			blocks = reallocarray(blocks, cap, sizeof(struct block));
+		}
+		blocks[nblocks++] = b;
+	}
+	
+	*out = blocks;
+	*out_len = nblocks;
+	
+	return 0;
+}
+
+static enum parse_status
+parse_image(struct doc_ctx *ctx, struct node *out, size_t *i, char const *data)
+{
+	*i += 3;
+	size_t begin = *i;
+	*i += strcspn(&data[*i], "\n");
+	
+	if (out)
+	{
+		*out = (struct node)
+		{
+			.type = NT_IMAGE,
+		};
+		out->data[0] = htmlified_substr(ctx, data, begin, *i, HS_FORCE_RAW);
+		if (!out->data[0])
+			return PS_ERR;
+	}
+	
+	return PS_OK;
+}
+
+static enum parse_status
+parse_long_code(struct doc_ctx *ctx, struct node *out, size_t *i, char const *data)
+{
+	*i += 4;
+	size_t begin = *i;
+	*i = block_end(data, *i, BE_CODE_FENCE);
+	
+	if (out)
+	{
+		*out = (struct node)
+		{
+			.type = NT_LONG_CODE,
+		};
+		out->data[0] = htmlified_substr(ctx, data, begin, *i, HS_NONE);
+		if (!out->data[0])
+			return PS_ERR;
+	}
+	
+	if (data[*i])
+		*i += 4;
+	
+	return PS_OK;
+}
+
+// blocks are mostly context-free, so once indexed they can be parsed by
+// multiple threads and reassembled in order. the raw text state is the only
+// context carried between blocks, and the index records it per block.
+static int
+parse_parallel(struct doc_ctx *ctx, struct node *out, char const *data, size_t len, char const *file)
+{
+	struct block *blocks;
+	size_t nblocks;
+	if (parse_index(ctx, &blocks, &nblocks, data, len, file))
+		return 1;
+	
+	*out = (struct node)
+	{
+		.type = NT_ROOT,
+		.children = arena_alloc(&ctx->arena, nblocks * sizeof(struct node)),
+		.nchildren = nblocks,
+		.children_cap = nblocks,
+	};
+	if (!out->children)
+	{
+		free(blocks);
+		return doc_oom(ctx);
+	}
+	
+	int rc = parse_blocks(ctx, out->children, blocks, nblocks, data, len, file, ctx->parse_jobs);
+	free(blocks);
+	
+	return rc;
+}
+
+// parse indexed blocks into `nodes` with up to `njobs` threads. the nodes are
+// owned by the worker contexts of `ctx`.
+static int
+parse_blocks(struct doc_ctx *ctx,
+             struct node *nodes,
+             struct block const *blocks,
+             size_t nblocks,
+             char const *data,
+             size_t len,
+             char const *file,
+             int njobs)
+{
+	// group consecutive blocks into jobs of a reasonable size.
+	size_t *chunks = malloc((nblocks + 1) * sizeof(size_t));
+	size_t nchunks = 0;
+	for (size_t i = 0; i < nblocks;)
+	{
+		chunks[nchunks++] = i;
+		size_t begin = blocks[i].begin;
+		while (i < nblocks && blocks[i].begin - begin < PARALLEL_PARSE_CHUNK)
+			++i;
+	}
+	chunks[nchunks] = nblocks;
+	
+	ctx->nworkers = njobs;
+	ctx->workers = calloc(ctx->nworkers, sizeof(struct doc_ctx));
+	for (int i = 0; i < ctx->nworkers; ++i)
+	{
+		ctx->workers[i] = (struct doc_ctx)
+		{
+			.markup_file = ctx->markup_file,
+		};
+	}
+	
+	int *rcs = calloc(nchunks, sizeof(int));
+	struct cmfc_error *errs = malloc(nchunks * sizeof(struct cmfc_error));
+	struct parse_job_arg arg =
+	{
+		.ctx = ctx,
+		.blocks = blocks,
+		.chunks = chunks,
+		.nodes = nodes,
+		.data = data,
+		.len = len,
+		.file = file,
+		.rcs = rcs,
+		.errs = errs,
+	};
+	cmfc_pool_run(nchunks, ctx->nworkers, parse_parallel_job, &arg);
+	
+	// the footnotes mentioned by the workers are entered into the table with
+	// the rest, their names being owned by the workers.
+	for (int i = 0; i < ctx->nworkers; ++i)
+	{
+		struct doc_ctx *wctx = &ctx->workers[i];
+		if (!wctx->nfn_mentions)
+			continue;
+		
+		if (ctx->nfn_mentions + wctx->nfn_mentions > ctx->fn_mentions_cap)
+		{
+			ctx->fn_mentions_cap = ctx->nfn_mentions + wctx->nfn_mentions;
+			ctx->fn_mentions = reallocarray(ctx->fn_mentions, ctx->fn_mentions_cap, sizeof(struct footnote_mention));
+		}
+		
+		memcpy(&ctx->fn_mentions[ctx->nfn_mentions], wctx->fn_mentions, wctx->nfn_mentions * sizeof(struct footnote_mention));
+		ctx->nfn_mentions += wctx->nfn_mentions;
+		wctx->nfn_mentions = 0;
+	}
+	
+	// report the first error in the document, as a sequential parse would.
+	int rc = 0;
+	for (size_t i = 0; i < nchunks && !rc; ++i)
+	{
+		if (rcs[i])
+		{
+			ctx->err = errs[i];
+			ctx->err_set = true;
+			rc = 1;
+		}
+	}
+	
+	free(errs);
+	free(rcs);
+	free(chunks);
+	
+	return rc;
+}
+
+static void
+parse_parallel_job(void *arg, size_t job, int worker)
+{
+	struct parse_job_arg const *pja = arg;
+	struct doc_ctx *wctx = &pja->ctx->workers[worker];
+	
+	for (size_t b = pja->chunks[job]; b < pja->chunks[job + 1]; ++b)
+	{
+		size_t i = pja->blocks[b].begin;
+		wctx->raw_text = pja->blocks[b].raw_text;
+		if (parse_any(wctx, &pja->nodes[b], &i, pja->data, pja->len, pja->file) != PS_OK)
+		{
+			// the worker goes on to other jobs, so the error is moved out.
+			pja->rcs[job] = 1;
+			pja->errs[job] = wctx->err;
+			wctx->err_set = false;
+			return;
+		}
+	}
+}
+
+static enum parse_status
+parse_o_list(struct doc_ctx *ctx,
+             struct node *out,
+             size_t *i,
+             char const *data,
+             size_t len,
+             char const *file)
+{
+	if (out)
+	{
+		*out = (struct node)
+		{
+			.type = NT_O_LIST,
+		};
+	}
+	
+	for (;;)
+	{
+		size_t item_begin = *i;
+		int depth = 0;
+		while (data[*i] == '#')
+		{
+			++*i;
+			++depth;
+		}
+		
+		// each level of depth is generated as a list of its own.
+		if (depth > CMFC_MAX_LIST_DEPTH)
+		{
+			prog_err(ctx, file, data, item_begin, "maximum list depth is " STRINGIFY(CMFC_MAX_LIST_DEPTH));
+			return PS_ERR;
+		}
+		
+		size_t begin = *i;
+		*i = block_end(data, *i, BE_BLANK | BE_O_ITEM);
+		
+		if (out)
+		{
+			struct node item =
+			{
+				.type = NT_LIST_ITEM,
+				.arg = depth,
+			};
+			item.data[0] = htmlified_substr(ctx, data, begin, *i, HS_NONE);
+			if (!item.data[0] || node_add_child(ctx, out, &item))
+				return PS_ERR;
+		}
+		
+		++*i;
+		if (*i >= len || data[*i] == '\n')
+			break;
+	}
+	
+	return PS_OK;
+}
+
+static enum parse_status
+parse_paragraph(struct doc_ctx *ctx, struct node *out, size_t *i, char const *data)
+{
+	*i += 4 * !strncmp("    ", &data[*i], 4);
+	size_t begin = *i;
+	*i = block_end(data, *i, BE_BLANK | BE_INDENT);
+	
+	if (out)
+	{
+		*out = (struct node)
+		{
+			.type = NT_PARAGRAPH,
+		};
+		out->data[0] = htmlified_substr(ctx, data, begin, *i, HS_NONE);
+		if (!out->data[0])
+			return PS_ERR;
+	}
+	
+	return PS_OK;
+}
+
+static enum parse_status
+parse_table(struct doc_ctx *ctx,
+            struct node *out,
+            size_t *i,
+            char const *data,
+            size_t len,
+            char const *file)
+{
+	// validate beginning of table.
+	{
+		while (data[*i] && data[*i] == '-')
+			++*i;
+		if (data[*i] != '\n')
+		{
+			prog_err(ctx, file, data, *i, "expected valid table after ---");
+			return PS_ERR;
+		}
+	}
+	
+	if (out)
+	{
+		*out = (struct node)
+		{
+			.type = NT_TABLE,
+		};
+	}
+	
+	for (++*i; data[*i] && data[*i] != '\n';)
+	{
+		if (data[*i] == '|')
+		{
+			struct node row;
+			if (parse_table_row(ctx, out ? &row : NULL, i, data, len, file))
+				return PS_ERR;
+			if (out && node_add_child(ctx, out, &row))
+				return PS_ERR;
+		}
+		else
+		{
+			prog_err(ctx, file, data, *i, "expected either | or table end");
+			return PS_ERR;
+		}
+	}
+	
+	return PS_OK;
+}
+
+static enum parse_status
+parse_table_row(struct doc_ctx *ctx,
+                struct node *out,
+                size_t *i,
+                char const *data,
+                size_t len,
+                char const *file)
+{
+	if (out)
+	{
+		*out = (struct node)
+		{
+			.type = NT_TABLE_ROW,
+		};
+	}
+	
+	++*i;
+	size_t col = 0;
+	for (;;)
+	{
+		size_t begin = *i;
+		while (data[*i] && data[*i] != '|')
+		{
+			if (*i + 1 < len && data[*i] == '\\')
+				++*i;
+			++*i;
+		}
+		if (!data[*i])
+		{
+			prog_err(ctx, file, data, *i, "incomplete table row data");
+			return PS_ERR;
+		}
+		
+		if (out)
+		{
+			size_t sub_len = htmlify(ctx, data, begin, *i, HS_NONE);
+			if (ctx->err_set)
+				return PS_ERR;
+			
+			if (col >= out->nchildren)
+			{
+				if (col >= ctx->cells_cap)
+				{
+					ctx->cells_cap = ctx->cells_cap ? 2 * ctx->cells_cap : 16;
+					ctx->cells = reallocarray(ctx->cells, ctx->cells_cap, sizeof(struct cell_buf));
+				}
+				
+				ctx->cells[col] = (struct cell_buf)
+				{
+					.len = sub_len,
+					.cap = sub_len + 1,
+				};
+				
+				struct node item =
+				{
+					.type = NT_TABLE_ITEM,
+				};
+				item.data[0] = arena_realloc(&ctx->arena, NULL, 0, sub_len + 1);
+				if (!item.data[0])
+					return doc_oom(ctx);
+				
+				memcpy(item.data[0], ctx->scratch, sub_len + 1);
+				if (node_add_child(ctx, out, &item))
+					return PS_ERR;
+			}
+			else
+			{
+				// continuation lines are appended onto the existing cell,
+				// growing it geometrically.
+				struct cell_buf *cb = &ctx->cells[col];
+				char **cell = &out->children[col].data[0];
+				
+				size_t need = cb->len + sub_len + 2;
+				if (need > cb->cap)
+				{
+					size_t new_cap = need > 2 * cb->cap ? need : 2 * cb->cap;
+					char *new_cell = arena_realloc(&ctx->arena, *cell, cb->cap, new_cap);
+					if (!new_cell)
+						return doc_oom(ctx);
+					
+					*cell = new_cell;
+					cb->cap = new_cap;
+				}
+				
+				(*cell)[cb->len] = ' ';
+				memcpy(&(*cell)[cb->len + 1], ctx->scratch, sub_len + 1);
+				cb->len += sub_len + 1;
+			}
+		}
+		
+		++*i;
+		if (data[*i] == '\n')
+		{
+			++*i;
+			col = 0;
+			if (!data[*i])
+			{
+				prog_err(ctx, file, data, *i, "unterminated table row");
+				return PS_ERR;
+			}
+			else if (data[*i] == '-')
+			{
+				while (data[*i] && data[*i] == '-')
+					++*i;
+				
+				if (data[*i] && data[*i] != '\n')
+				{
+					prog_err(ctx, file, data, *i, "table row improperly terminated");
+					return PS_ERR;
+				}
+				
+				++*i;
+				break;
+			}
+			else if (data[*i] == '|')
+				++*i;
+			else
+			{
+				prog_err(ctx, file, data, *i, "expected row to either terminate or continue");
+				return PS_ERR;
+			}
+		}
+		else
+			++col;
+	}
+	
+	return PS_OK;
+}
+
+static enum parse_status
+parse_title(struct doc_ctx *ctx, struct node *out, size_t *i, char const *data, char const *file)
+{
+	// get and validate header size.
+	int hsize = 0;
+	{
+		size_t title_begin = *i;
+		while (data[*i] == '=')
+		{
+			++*i;
+			++hsize;
+		}
+		
+		if (hsize > 6)
+		{
+			prog_err(ctx, file, data, title_begin, "minimum title size is 6");
+			return PS_ERR;
+		}
+	}
+	
+	size_t begin = *i;
+	*i = block_end(data, *i, BE_BLANK);
+	
+	if (out)
+	{
+		*out = (struct node)
+		{
+			.type = NT_TITLE,
+			.arg = hsize,
+		};
+		out->data[0] = htmlified_substr(ctx, data, begin, *i, HS_NONE);
+		if (!out->data[0])
+			return PS_ERR;
+	}
+	
+	return PS_OK;
+}
+
+static enum parse_status
+parse_u_list(struct doc_ctx *ctx,
+             struct node *out,
+             size_t *i,
+             char const *data,
+             size_t len,
+             char const *file)
+{
+	if (out)
+	{
+		*out = (struct node)
+		{
+			.type = NT_U_LIST,
+		};
+	}
+	
+	for (;;)
+	{
+		size_t item_begin = *i;
+		int depth = 0;
+		while (data[*i] == '*')
+		{
+			++*i;
+			++depth;
+		}
+		
+		// each level of depth is generated as a list of its own.
+		if (depth > CMFC_MAX_LIST_DEPTH)
+		{
+			prog_err(ctx, file, data, item_begin, "maximum list depth is " STRINGIFY(CMFC_MAX_LIST_DEPTH));
+			return PS_ERR;
+		}
+		
+		size_t begin = *i;
+		*i = block_end(data, *i, BE_BLANK | BE_U_ITEM);
+		
+		if (out)
+		{
+			struct node item =
+			{
+				.type = NT_LIST_ITEM,
+				.arg = depth,
+			};
+			item.data[0] = htmlified_substr(ctx, data, begin, *i, HS_NONE);
+			if (!item.data[0] || node_add_child(ctx, out, &item))
+				return PS_ERR;
+		}
+		
+		++*i;
+		if (*i >= len || data[*i] == '\n')
+			break;
+	}
+	
+	return PS_OK;
+}
+
+static void *
+pool_worker(void *arg)
+{
+	struct pool_worker_arg const *wa = arg;
+	struct pool *pool = wa->pool;
+	struct pool_deque *own = &pool->deques[wa->id];
+	
+	for (;;)
+	{
+		// take the next job from the front of our own deque.
+		size_t job = SIZE_MAX;
+		{
+			pthread_mutex_lock(&own->lock);
+			if (own->head < own->tail)
+				job = own->head++;
+			pthread_mutex_unlock(&own->lock);
+		}
+		
+		if (job != SIZE_MAX)
+		{
+			pool->fn(pool->arg, job, wa->id);
+			continue;
+		}
+		
+		// out of work, steal the back half of another worker's deque.
+		// jobs are never created, only moved, so once every deque is seen
+		// to be empty there is nothing left to do.
+		bool stolen = false;
+		for (int i = 1; i < pool->nworkers && !stolen; ++i)
+		{
+			struct pool_deque *victim = &pool->deques[(wa->id + i) % pool->nworkers];
+			
+			pthread_mutex_lock(&victim->lock);
+			size_t head = victim->head, tail = victim->tail;
+			if (head < tail)
+			{
+				victim->tail = tail - (tail - head + 1) / 2;
+				head = victim->tail;
+				stolen = true;
+			}
+			pthread_mutex_unlock(&victim->lock);
+			
+			if (stolen)
+			{
+				pthread_mutex_lock(&own->lock);
+				own->head = head;
+				own->tail = tail;
+				pthread_mutex_unlock(&own->lock);
+			}
+		}
+		
+		if (!stolen)
+			break;
+	}
+	
+	return NULL;
+}
+
+static void
+prog_err(struct doc_ctx *ctx, char const *file, char const *data, size_t start, char const *msg)
+{
+	if (ctx->err_set)
+		return;
+	
+	ctx->err_set = true;
+	ctx->err = (struct cmfc_error)
+	{
+		.file = file,
+		.has_pos = true,
+		.pos = ctx->pos_base + start,
+	};
+	snprintf(ctx->err.msg, sizeof(ctx->err.msg), "%s", msg);
+	single_line(ctx->err.line, sizeof(ctx->err.line), data, start);
+}
+
+// copy a single line of a larger string into `buf` as a null-terminated
+// string; only suitable for temporary uses, e.g. error messages.
+static char const *
+single_line(char *buf, size_t size, char const *s, size_t start)
+{
+	size_t i;
+	for (i = 0; i < size - 1; ++i)
+	{
+		if (!s[start + i])
+			break;
+		
+		if (s[start + i] == '\n')
+			break;
+		
+		buf[i] = s[start + i];
+	}
+	buf[i] = 0;
+	
+	return buf;
+}
+
+// the current time, if statistics are being gathered; otherwise 0, sparing
+// uninstrumented compiles the cost of reading the clock.
+static double
+stats_clock(struct doc_ctx const *ctx)
+{
+	if (!ctx->stats)
+		return 0;
+	
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void
+stats_count_nodes(struct cmfc_stats *stats, struct node const *node)
+{
+	++stats->nodes[node->type];
+	for (size_t i = 0; i < node->nchildren; ++i)
+		stats_count_nodes(stats, &node->children[i]);
+}
+
+// complete the statistics of a compile once it is done, before its context is
+// released.
+static void
+stats_finish(struct doc_ctx *ctx, size_t in_len, size_t out_len)
+{
+	if (!ctx->stats)
+		return;
+	
+	ctx->stats->bytes_in = in_len;
+	ctx->stats->bytes_out = out_len;
+	
+	ctx->stats->allocs += ctx->arena.nallocs;
+	for (int i = 0; i < ctx->nworkers; ++i)
+		ctx->stats->allocs += ctx->workers[i].arena.nallocs;
+	
+	stats_sample_mem(ctx, 0);
+}
+
+// memory held by a context and the contexts of its parse threads.
+static size_t
+stats_mem(struct doc_ctx const *ctx)
+{
+	size_t mem = ctx->arena.held + ctx->scratch_cap + ctx->cells_cap * sizeof(struct cell_buf);
+	if (!ctx->out.fixed)
+		mem += ctx->out.cap;
+	
+	for (int i = 0; i < ctx->nworkers; ++i)
+		mem += stats_mem(&ctx->workers[i]);
+	
+	return mem;
+}
+
+// update the peak memory use of a compile, with `extra` bytes held outside of
+// its context.
+static void
+stats_sample_mem(struct doc_ctx *ctx, size_t extra)
+{
+	size_t mem = stats_mem(ctx) + extra;
+	if (mem > ctx->stats->peak_mem)
+		ctx->stats->peak_mem = mem;
+}
+
+static void
+str_dyn_append_s(char **str, size_t *len, size_t *cap, char const *s)
+{
+	size_t slen = strlen(s);
+	
+	// grow dynamic string as necessary.
+	{
+		while (*len + slen + 1 >= *cap)
+		{
+			*cap *= 2;
+			*str = realloc(*str, *cap);
+		}
+	}
+	
+	// write new data.
+	{
+		strcpy(&(*str)[*len], s);
+		*len += slen;
+	}
+}
+
+static void
+str_dyn_append_c(char **str, size_t *len, size_t *cap, char c)
+{
+	// grow dynamic string as necessary.
+	{
+		if (*len + 1 >= *cap)
+		{
+			*cap *= 2;
+			*str = realloc(*str, *cap);
+		}
+	}
+	
+	// write new data.
+	{
+		(*str)[*len] = c;
+		(*str)[*len + 1] = 0;
+		++*len;
+	}
+}
+
+static void
+str_dyn_append_n(char **str, size_t *len, size_t *cap, char const *s, size_t n)
+{
+	// grow dynamic string as necessary.
+	{
+		while (*len + n + 1 >= *cap)
+		{
+			*cap *= 2;
+			*str = realloc(*str, *cap);
+		}
+	}
+	
+	// write new data.
+	{
+		memcpy(&(*str)[*len], s, n);
+		(*str)[*len + n] = 0;
+		*len += n;
+	}
+}
+
+// drop consumed input from a stream buffer and read more. at least as much as
+// is still buffered is read, so that repeatedly re-parsing a growing
+// incomplete block stays linear overall.
+static int
+stream_read(struct stream_buf *sb, cmfc_read_fn read, void *user)
+{
+	if (sb->pos)
+	{
+		memmove(sb->data, &sb->data[sb->pos], sb->len - sb->pos);
+		sb->len -= sb->pos;
+		sb->pos = 0;
+	}
+	
+	size_t want = sb->len > STREAM_CHUNK ? sb->len : STREAM_CHUNK;
+	if (sb->len + want + STREAM_PAD > sb->cap)
+	{
+		sb->cap = sb->len + want + STREAM_PAD;
+		sb->data = realloc(sb->data, sb->cap);
+	}
+	
+	for (size_t got = 0; got < want;)
+	{
+		long nread = read(user, &sb->data[sb->len], want - got);
+		if (nread < 0)
+			return 1;
+		
+		if (nread == 0)
+		{
+			sb->eof = true;
+			break;
+		}
+		
+		sb->len += nread;
+		got += nread;
+	}
+	
+	memset(&sb->data[sb->len], 0, STREAM_PAD);
+	
+	return 0;
+}
+
+// whether a rule whose selectors are `prelude` belongs to the critical subset
+// of its stylesheet.
+static bool
+style_rule_critical(char const *prelude, size_t len)
+{
+	for (size_t begin = 0, end; begin < len; begin = end + 1)
+	{
+		char const *comma = memchr(&prelude[begin], ',', len - begin);
+		end = comma ? (size_t)(comma - prelude) : len;
+		
+		size_t lb = begin, ub = end;
+		while (lb < ub && isspace((unsigned char)prelude[lb]))
+			++lb;
+		while (ub > lb && isspace((unsigned char)prelude[ub - 1]))
+			--ub;
+		
+		bool found = false;
+		for (size_t i = 0; i < sizeof(style_critical_sels) / sizeof(style_critical_sels[0]); ++i)
+		{
+			if (strlen(style_critical_sels[i]) == ub - lb && !strncmp(style_critical_sels[i], &prelude[lb], ub - lb))
+				found = true;
+		}
+		
+		if (!found)
+			return false;
+	}
+	
+	return len > 0;
+}
+
+// find the next of the `stops` characters in a stylesheet from `i` onwards,
+// skipping over strings and comments, or return `len` if there is none.
+static size_t
+style_skip(char const *style, size_t len, size_t i, char const *stops)
+{
+	for (; i < len; ++i)
+	{
+		if (style[i] && strchr(stops, style[i]))
+			return i;
+		
+		if (style[i] == '"' || style[i] == '\'')
+		{
+			char quote = style[i];
+			for (++i; i < len && style[i] != quote; ++i)
+			{
+				if (style[i] == '\\')
+					++i;
+			}
+		}
+		else if (style[i] == '/' && i + 1 < len && style[i + 1] == '*')
+		{
+			for (i += 2; i + 1 < len && !(style[i] == '*' && style[i + 1] == '/'); ++i)
+				;
+			++i;
+		}
+	}
+	
+	return len;
+}
+
+// copy the next word of text from `*i` into `buf`, lowercased, returning its
+// length, or 0 once the text is exhausted. words are runs of letters, digits,
+// underscores and non-ASCII characters, within which apostrophes are left out.
+// anything else separates them, including the tags and entities of HTMLified
+// text, which are skipped whole. raw text has neither.
+static size_t
+text_word(char const *s, size_t *i, char *buf, bool raw_text)
+{
+	size_t len = 0;
+	for (; s[*i]; ++*i)
+	{
+		// this runs over every byte of text indexed, so it avoids the ctype
+		// functions.
+		unsigned char ch = s[*i];
+		if ((ch | 0x20) - 'a' < 26u || ch - '0' < 10u || ch == '_' || ch >= 0x80)
+			buf[len++] = ch - 'A' < 26u ? ch | 0x20 : ch;
+		else if (ch == '\'')
+			continue;
+		else if (!raw_text && !strncmp(&s[*i], "&apos;", 6))
+			*i += 5;
+		else if (!raw_text && ch == '<')
+		{
+			char const *end = strchr(&s[*i], '>');
+			if (!end)
+			{
+				*i += strlen(&s[*i]);
+				break;
+			}
+			*i = end - s;
+			if (len)
+				break;
+		}
+		else
+		{
+			char const *end = !raw_text && ch == '&' ? strchr(&s[*i], ';') : NULL;
+			if (end)
+				*i = end - s;
+			if (len)
+				break;
+		}
+	}
+	
+	return len;
+}
+
+// pass each word of text to the word callback.
+static void
+text_words(struct doc_ctx *ctx, char const *s, bool raw_text)
+{
+	size_t n = strlen(s) + 1;
+	if (n > ctx->scratch_cap)
+	{
+		ctx->scratch_cap = n;
+		ctx->scratch = realloc(ctx->scratch, n);
+	}
+	
+	size_t i = 0, len;
+	while ((len = text_word(s, &i, ctx->scratch, raw_text)))
+		ctx->word(ctx->word_user, ctx->scratch, len);
+}